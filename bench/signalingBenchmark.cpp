@@ -0,0 +1,386 @@
+// Signaling hot paths against checked-in room capabilities and Chrome Plan B
+// offers (bench/fixtures).
+//
+//   ./signalingBenchmark --benchmark_format=json > results.json
+//
+// Each benchmark is registered once per room size and offer, as
+// <function>/<room>/<offer>. The answer writer is also compared with the
+// json session object plus sdptransform::write it replaced, for offers of
+// 1, 10 and 100 m-sections, as <function>/sections/<count>.
+
+#include <benchmark/benchmark.h>
+#include <sdptransform/sdptransform.hpp>
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "RemotePlanBSdp.h"
+#include "RoomCapabilities.h"
+#include "sdpUtils.h"
+
+using json = nlohmann::json;
+using std::string;
+
+#ifndef MEDIASOUP_FIXTURES_DIR
+#define MEDIASOUP_FIXTURES_DIR "bench/fixtures"
+#endif
+
+namespace {
+  const char* roomSizes[] = { "small", "medium", "large" };
+  const char* offers[] = { "chrome-planb-audio", "chrome-planb-audio-video" };
+
+  string readFixture(string const& name) {
+    std::ifstream file(string(MEDIASOUP_FIXTURES_DIR) + "/" + name);
+    if (!file) {
+      throw std::runtime_error("Could not read fixture " + name);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+
+  struct Fixture {
+    string offer;
+    json roomSettings;
+    std::shared_ptr<const RoomCapabilities> room;
+    json clientCapabilities;
+    json extendedCapabilities;
+
+    Fixture(string const& roomSize, string const& offerName)
+      : offer(readFixture(offerName + ".sdp")),
+        roomSettings(json::parse(readFixture("room-capabilities-" + roomSize + ".json"))),
+        room(RoomCapabilities::compile(JsonView(roomSettings))) {
+      clientCapabilities = commonUtils::extractRtpCapabilities(sdpScanner::scan(offer));
+      extendedCapabilities = ortc::getExtendedRtpCapabilities(
+        clientCapabilities, room->capabilities(), room->capabilitiesIndex());
+    }
+
+    // The send transport's RTP parameters, in the shape SendRemoteSdp takes.
+    json sendRtpParametersByKind() const {
+      json byKind = json::object();
+      for (auto const& codec : extendedCapabilities.at("codecs")) {
+        auto& parameters = byKind[codec.at("kind").get<string>()];
+        parameters["codecs"].push_back({
+          {"name", codec.at("name")},
+          {"mimeType", codec.at("mimeType")},
+          {"payloadType", codec.at("sendPayloadType")},
+          {"clockRate", codec.at("clockRate")},
+          {"channels", codec.value("channels", 1)},
+          {"parameters", codec.at("parameters")},
+          {"rtcpFeedback", codec.at("rtcpFeedback")}
+        });
+        if (codec.at("sendRtxPayloadType").is_number()) {
+          parameters["codecs"].push_back({
+            {"name", "rtx"},
+            {"mimeType", codec.at("kind").get<string>() + "/rtx"},
+            {"payloadType", codec.at("sendRtxPayloadType")},
+            {"clockRate", codec.at("clockRate")},
+            {"parameters", {{"apt", codec.at("sendPayloadType")}}}
+          });
+        }
+      }
+      for (auto const& ext : extendedCapabilities.at("headerExtensions")) {
+        auto& parameters = byKind[ext.at("kind").get<string>()];
+        parameters["headerExtensions"].push_back({
+          {"uri", ext.at("uri")},
+          {"id", ext.at("sendId")}
+        });
+      }
+      return byKind;
+    }
+  };
+
+  json transportRemoteParameters() {
+    return {
+      {"iceParameters", {
+        {"usernameFragment", "4x2ydcnm0kd8jzjp"},
+        {"password", "m5jqrblgyw8qv5n1yzx0ut2ddntwbf1b"},
+        {"iceLite", true}
+      }},
+      {"iceCandidates", {
+        {{"foundation", "udpcandidate"}, {"ip", "192.0.2.10"}, {"port", 40534}, {"priority", 1078862079},
+         {"protocol", "udp"}, {"type", "host"}},
+        {{"foundation", "tcpcandidate"}, {"ip", "192.0.2.10"}, {"port", 40535}, {"priority", 1078862078},
+         {"protocol", "tcp"}, {"type", "host"}, {"tcpType", "passive"}}
+      }},
+      {"dtlsParameters", {
+        {"role", "auto"},
+        {"fingerprints", {
+          {{"algorithm", "sha-256"},
+           {"value", "D1:8C:47:6A:31:A0:5B:9E:7C:22:F4:86:0E:BD:13:59:C8:4F:71:2A:E6:95:3D:08:B7:64:FA:1E:C3:52:9B:06"}}
+        }}
+      }}
+    };
+  }
+
+  // Cached: every iteration after the first is a cache hit, as when joining
+  // rooms of a server whose capabilities were seen before.
+  void getEffectiveClientRtpCapabilitiesCached(benchmark::State& state, Fixture const* fixture) {
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(getEffectiveClientRtpCapabilities(fixture->offer, *fixture->room));
+    }
+  }
+
+  // Uncached: scans the offer and negotiates on every call.
+  void getEffectiveClientRtpCapabilitiesUncached(benchmark::State& state, Fixture const* fixture) {
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(getEffectiveClientRtpCapabilities(fixture->offer, fixture->roomSettings));
+    }
+  }
+
+  void getExtendedRtpCapabilities(benchmark::State& state, Fixture const* fixture) {
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(ortc::getExtendedRtpCapabilities(
+        fixture->clientCapabilities, fixture->room->capabilities(), fixture->room->capabilitiesIndex()));
+    }
+  }
+
+  void getRtpCapabilities(benchmark::State& state, Fixture const* fixture) {
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(ortc::getRtpCapabilities(fixture->extendedCapabilities));
+    }
+  }
+
+  // The first answer of a send transport, rendering every m-section.
+  void createAnswerSdpFirst(benchmark::State& state, Fixture const* fixture) {
+    auto rtpParametersByKind = fixture->sendRtpParametersByKind();
+    auto remoteParameters = transportRemoteParameters();
+    for (auto _ : state) {
+      SendRemoteSdp remoteSdp(rtpParametersByKind);
+      remoteSdp.setTransportLocalParameters({{"role", "client"}});
+      remoteSdp.setTransportRemoteParameters(remoteParameters);
+      benchmark::DoNotOptimize(remoteSdp.createAnswerSdp(fixture->offer).data());
+    }
+  }
+
+  // A renegotiation answer, reusing the m-sections already rendered.
+  void createAnswerSdpRenegotiation(benchmark::State& state, Fixture const* fixture) {
+    SendRemoteSdp remoteSdp(fixture->sendRtpParametersByKind());
+    remoteSdp.setTransportLocalParameters({{"role", "client"}});
+    remoteSdp.setTransportRemoteParameters(transportRemoteParameters());
+    remoteSdp.createAnswerSdp(fixture->offer);
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(remoteSdp.createAnswerSdp(fixture->offer).data());
+    }
+  }
+
+  // A local offer with the given number of m-sections, alternating audio
+  // and video, with mids 0, 1...
+  string offerWithSections(int count) {
+    string offer =
+      "v=0\r\n"
+      "o=- 6817363741462853715 2 IN IP4 127.0.0.1\r\n"
+      "s=-\r\n"
+      "t=0 0\r\n";
+    for (int i = 0; i < count; i++) {
+      offer += i % 2 == 0 ? "m=audio 9 UDP/TLS/RTP/SAVPF 111\r\n" : "m=video 9 UDP/TLS/RTP/SAVPF 96 97\r\n";
+      offer += "c=IN IP4 0.0.0.0\r\n";
+      offer += "a=mid:" + std::to_string(i) + "\r\n";
+      offer += "a=sendrecv\r\n";
+    }
+    return offer;
+  }
+
+  // The answer createAnswerSdp renders, as a session object for
+  // sdptransform::write, built the way SendRemoteSdp did before SdpWriter.
+  json answerSdpObj(sdpScanner::SessionDescription const& localSdpObj, json const& rtpParametersByKind,
+                    json const& remoteParameters, int sessionVersion) {
+    auto const& remoteIceParameters = remoteParameters.at("iceParameters");
+    auto const& remoteDtlsParameters = remoteParameters.at("dtlsParameters");
+    auto const& lastFingerprint = remoteDtlsParameters.at("fingerprints").back();
+
+    string mids;
+    for (auto const& localMediaObj : localSdpObj.media) {
+      if (!mids.empty()) {
+        mids += ' ';
+      }
+      mids += localMediaObj.mid.to_string();
+    }
+
+    json sdpObj = {
+      {"version", 0},
+      {"origin", {
+        {"address", "0.0.0.0"},
+        {"ipVer", 4},
+        {"netType", "IN"},
+        {"sessionId", 1234},
+        {"sessionVersion", sessionVersion},
+        {"username", "mediasoup-client"}
+      }},
+      {"name", "-"},
+      {"timing", {{"start", 0}, {"stop", 0}}},
+      {"icelite", "ice-lite"},
+      {"msidSemantic", {{"semantic", "WMS"}, {"token", "*"}}},
+      {"groups", {{{"type", "BUNDLE"}, {"mids", mids}}}},
+      {"fingerprint", {{"type", lastFingerprint.at("algorithm")}, {"hash", lastFingerprint.at("value")}}},
+      {"media", json::array()}
+    };
+
+    for (auto const& localMediaObj : localSdpObj.media) {
+      auto kind = localMediaObj.type.to_string();
+      auto const& rtpParameters = rtpParametersByKind.at(kind);
+
+      json remoteMediaObj = {
+        {"type", kind},
+        {"port", 7},
+        {"protocol", "RTP/SAVPF"},
+        {"connection", {{"ip", "127.0.0.0"}, {"version", 4}}},
+        {"iceUfrag", remoteIceParameters.at("usernameFragment")},
+        {"icePwd", remoteIceParameters.at("password")},
+        {"candidates", json::array()},
+        {"endOfCandidates", "end-of-candidates"},
+        {"iceOptions", "renomination"},
+        {"setup", "active"},
+        {"mid", localMediaObj.mid.to_string()},
+        {"direction", "recvonly"},
+        {"rtcpMux", "rtcp-mux"},
+        {"rtp", json::array()},
+        {"rtcpFb", json::array()},
+        {"fmtp", json::array()},
+        {"ext", json::array()}
+      };
+
+      for (auto const& candidate : remoteParameters.at("iceCandidates")) {
+        json candidateObj = {
+          {"component", 1},
+          {"foundation", candidate.at("foundation")},
+          {"ip", candidate.at("ip")},
+          {"port", candidate.at("port")},
+          {"priority", candidate.at("priority")},
+          {"transport", candidate.at("protocol")},
+          {"type", candidate.at("type")}
+        };
+        if (candidate.count("tcpType") > 0) {
+          candidateObj.emplace("tcptype", candidate.at("tcpType"));
+        }
+        remoteMediaObj.at("candidates").push_back(candidateObj);
+      }
+
+      string payloads;
+      for (auto const& codec : rtpParameters.at("codecs")) {
+        if (!payloads.empty()) {
+          payloads += ' ';
+        }
+        payloads += std::to_string(codec.at("payloadType").get<int>());
+
+        json rtp = {
+          {"payload", codec.at("payloadType")},
+          {"codec", codec.at("name")},
+          {"rate", codec.at("clockRate")}
+        };
+        if (codec.value("channels", 1) > 1) {
+          rtp.emplace("encoding", codec.at("channels"));
+        }
+        remoteMediaObj.at("rtp").push_back(rtp);
+
+        for (auto const& fb : codec.value("rtcpFeedback", json::array())) {
+          json rtcpFb = {
+            {"payload", codec.at("payloadType")},
+            {"type", fb.at("type")}
+          };
+          if (fb.count("parameter") > 0 && !fb.at("parameter").get_ref<const string&>().empty()) {
+            rtcpFb.emplace("subtype", fb.at("parameter"));
+          }
+          remoteMediaObj.at("rtcpFb").push_back(rtcpFb);
+        }
+
+        auto parameters = codec.value("parameters", json::object());
+        if (!parameters.empty()) {
+          string config;
+          for (auto it = parameters.begin(); it != parameters.end(); ++it) {
+            if (!config.empty()) {
+              config += ';';
+            }
+            config += it.key() + "=" + (it.value().is_string() ? it.value().get<string>() : it.value().dump());
+          }
+          remoteMediaObj.at("fmtp").push_back({{"payload", codec.at("payloadType")}, {"config", config}});
+        }
+      }
+      remoteMediaObj.emplace("payloads", payloads);
+
+      for (auto const& ext : rtpParameters.at("headerExtensions")) {
+        if (rtpRegistry::findHeaderExtension(ext.at("uri").get_ref<const string&>()) ==
+            rtpRegistry::HeaderExtensionId::mid) {
+          continue;
+        }
+        remoteMediaObj.at("ext").push_back({{"value", ext.at("id")}, {"uri", ext.at("uri")}});
+      }
+
+      if (kind == "video") {
+        remoteMediaObj.emplace("xGoogleFlag", "conference");
+      }
+
+      sdpObj.at("media").push_back(std::move(remoteMediaObj));
+    }
+
+    return sdpObj;
+  }
+
+  // SdpWriter: every m-section rendered, as for a first answer.
+  void createAnswerSdpSections(benchmark::State& state, Fixture const* fixture) {
+    auto offer = offerWithSections(state.range(0));
+    auto rtpParametersByKind = fixture->sendRtpParametersByKind();
+    auto remoteParameters = transportRemoteParameters();
+    for (auto _ : state) {
+      SendRemoteSdp remoteSdp(rtpParametersByKind);
+      remoteSdp.setTransportLocalParameters({{"role", "client"}});
+      remoteSdp.setTransportRemoteParameters(remoteParameters);
+      benchmark::DoNotOptimize(remoteSdp.createAnswerSdp(offer).data());
+    }
+  }
+
+  // The same answer through a json session object and sdptransform::write.
+  void sdptransformWriteSections(benchmark::State& state, Fixture const* fixture) {
+    auto offer = offerWithSections(state.range(0));
+    auto rtpParametersByKind = fixture->sendRtpParametersByKind();
+    auto remoteParameters = transportRemoteParameters();
+    int sessionVersion = 0;
+    for (auto _ : state) {
+      auto sdpObj = answerSdpObj(sdpScanner::scan(offer), rtpParametersByKind, remoteParameters, ++sessionVersion);
+      benchmark::DoNotOptimize(sdptransform::write(sdpObj).data());
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<Fixture>> fixtures;
+  for (auto roomSize : roomSizes) {
+    for (auto offer : offers) {
+      fixtures.emplace_back(new Fixture(roomSize, offer));
+      auto fixture = fixtures.back().get();
+      auto suffix = string("/") + roomSize + "/" + offer;
+      benchmark::RegisterBenchmark(("getEffectiveClientRtpCapabilities/cached" + suffix).c_str(),
+        getEffectiveClientRtpCapabilitiesCached, fixture);
+      benchmark::RegisterBenchmark(("getEffectiveClientRtpCapabilities/uncached" + suffix).c_str(),
+        getEffectiveClientRtpCapabilitiesUncached, fixture);
+      benchmark::RegisterBenchmark(("ortc::getExtendedRtpCapabilities" + suffix).c_str(),
+        getExtendedRtpCapabilities, fixture);
+      benchmark::RegisterBenchmark(("ortc::getRtpCapabilities" + suffix).c_str(),
+        getRtpCapabilities, fixture);
+      benchmark::RegisterBenchmark(("SendRemoteSdp::createAnswerSdp/first" + suffix).c_str(),
+        createAnswerSdpFirst, fixture);
+      benchmark::RegisterBenchmark(("SendRemoteSdp::createAnswerSdp/renegotiation" + suffix).c_str(),
+        createAnswerSdpRenegotiation, fixture);
+    }
+  }
+
+  // Against the small room and the audio and video offer, so each
+  // m-section has a typical codec list.
+  auto sectionsFixture = fixtures[1].get();
+  benchmark::RegisterBenchmark("SendRemoteSdp::createAnswerSdp/sections",
+    createAnswerSdpSections, sectionsFixture)->Arg(1)->Arg(10)->Arg(100);
+  benchmark::RegisterBenchmark("sdptransform::write/sections",
+    sdptransformWriteSections, sectionsFixture)->Arg(1)->Arg(10)->Arg(100);
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,263 @@
+#ifndef _H264ProfileLevelId_h_
+#define _H264ProfileLevelId_h_
+
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include "json.hpp"
+
+using json = nlohmann::json;
+using std::string;
+
+/**
+ * H264 profile-level-id handling (RFC 6184), following what libwebrtc does
+ * in h264_profile_level_id.cc: two H264 codecs are only compatible when they
+ * have the same profile and packetization-mode, and the level of an answer
+ * is the lower of the two unless both allow level asymmetry.
+ *
+ * Parse codec parameters once with CodecParameters::fromJson and compare the
+ * results; nothing here looks at fmtp strings more than once.
+ */
+namespace h264 {
+  enum class Profile : uint8_t {
+    constrainedBaseline,
+    baseline,
+    main,
+    constrainedHigh,
+    high
+  };
+
+  // level_idc values; 1b is signalled with level_idc 11 and constraint_set3
+  // in the Baseline and Main profiles, and with level_idc 9 in the High ones.
+  enum class Level : uint8_t {
+    level1b = 0,
+    level1 = 10,
+    level1_1 = 11,
+    level1_2 = 12,
+    level1_3 = 13,
+    level2 = 20,
+    level2_1 = 21,
+    level2_2 = 22,
+    level3 = 30,
+    level3_1 = 31,
+    level3_2 = 32,
+    level4 = 40,
+    level4_1 = 41,
+    level4_2 = 42,
+    level5 = 50,
+    level5_1 = 51,
+    level5_2 = 52
+  };
+
+  struct ProfileLevelId {
+    Profile profile = Profile::constrainedBaseline;
+    Level level = Level::level3_1;
+  };
+
+  // Used when a codec has no profile-level-id, per RFC 6184.
+  constexpr const char* defaultProfileLevelId = "42e01f";
+
+  namespace detail {
+    // profile_iop bits to match: mask has the bits that are not 'x', value
+    // the ones that are '1'.
+    struct ProfilePattern {
+      uint8_t profileIdc;
+      uint8_t mask;
+      uint8_t value;
+      Profile profile;
+    };
+
+    constexpr ProfilePattern profilePatterns[] = {
+      {0x42, 0x4f, 0x40, Profile::constrainedBaseline}, // x1xx0000
+      {0x4d, 0x8f, 0x80, Profile::constrainedBaseline}, // 1xxx0000
+      {0x58, 0xcf, 0xc0, Profile::constrainedBaseline}, // 11xx0000
+      {0x42, 0x4f, 0x00, Profile::baseline},            // x0xx0000
+      {0x58, 0xcf, 0x80, Profile::baseline},            // 10xx0000
+      {0x4d, 0xaf, 0x00, Profile::main},                // 0x0x0000
+      {0x64, 0xff, 0x00, Profile::high},                // 00000000
+      {0x64, 0xff, 0x0c, Profile::constrainedHigh}      // 00001100
+    };
+
+    constexpr uint8_t constraintSet3 = 0x10;
+    constexpr uint8_t highLevel1b = 9;
+
+    bool parseHexByte(boost::string_view str, uint8_t& value) {
+      int result = 0;
+      for (auto c : str) {
+        int digit;
+        if (c >= '0' && c <= '9') {
+          digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+          digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+          digit = c - 'A' + 10;
+        } else {
+          return false;
+        }
+        result = result * 16 + digit;
+      }
+      value = static_cast<uint8_t>(result);
+      return true;
+    }
+
+    bool isValidLevel(uint8_t levelIdc) {
+      switch (levelIdc) {
+        case 10: case 11: case 12: case 13:
+        case 20: case 21: case 22:
+        case 30: case 31: case 32:
+        case 40: case 41: case 42:
+        case 50: case 51: case 52:
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    // Parameter values come as strings from an SDP and as numbers from the
+    // room capabilities.
+    int intParameter(json const& parameters, const char* name, int defaultValue) {
+      auto search = parameters.find(name);
+      if (search == parameters.end()) {
+        return defaultValue;
+      }
+      if (search->is_number_integer()) {
+        return search->get<int>();
+      }
+      if (search->is_string()) {
+        try {
+          return std::stoi(search->get_ref<const string&>());
+        } catch (std::exception const&) {
+          return defaultValue;
+        }
+      }
+      return defaultValue;
+    }
+  }
+
+  // Returns false if str is not a valid 6 hex digit profile-level-id.
+  bool parseProfileLevelId(boost::string_view str, ProfileLevelId& result) {
+    uint8_t profileIdc, profileIop, levelIdc;
+    if (str.size() != 6 ||
+        !detail::parseHexByte(str.substr(0, 2), profileIdc) ||
+        !detail::parseHexByte(str.substr(2, 2), profileIop) ||
+        !detail::parseHexByte(str.substr(4, 2), levelIdc)) {
+      return false;
+    }
+
+    for (auto const& pattern : detail::profilePatterns) {
+      if (pattern.profileIdc == profileIdc && (profileIop & pattern.mask) == pattern.value) {
+        bool isHigh = pattern.profile == Profile::constrainedHigh || pattern.profile == Profile::high;
+        if (isHigh && levelIdc == detail::highLevel1b) {
+          result.profile = pattern.profile;
+          result.level = Level::level1b;
+          return true;
+        }
+        if (!detail::isValidLevel(levelIdc)) {
+          return false;
+        }
+        result.profile = pattern.profile;
+        result.level = static_cast<Level>(levelIdc);
+        if (!isHigh && levelIdc == 11 && (profileIop & detail::constraintSet3) != 0) {
+          result.level = Level::level1b;
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  string profileLevelIdToString(ProfileLevelId const& profileLevelId) {
+    if (profileLevelId.level == Level::level1b) {
+      switch (profileLevelId.profile) {
+        case Profile::constrainedBaseline: return "42f00b";
+        case Profile::baseline: return "42100b";
+        case Profile::main: return "4d100b";
+        case Profile::constrainedHigh: return "640c09";
+        case Profile::high: return "640009";
+      }
+    }
+
+    const char* profileIdcIop = "";
+    switch (profileLevelId.profile) {
+      case Profile::constrainedBaseline: profileIdcIop = "42e0"; break;
+      case Profile::baseline: profileIdcIop = "4200"; break;
+      case Profile::main: profileIdcIop = "4d00"; break;
+      case Profile::constrainedHigh: profileIdcIop = "640c"; break;
+      case Profile::high: profileIdcIop = "6400"; break;
+    }
+
+    char level[3];
+    std::snprintf(level, sizeof(level), "%02x", static_cast<unsigned>(profileLevelId.level));
+    return string(profileIdcIop) + level;
+  }
+
+  // Level order, with 1b between 1 and 1.1.
+  bool isLess(Level a, Level b) {
+    if (a == Level::level1b) {
+      return b != Level::level1 && b != Level::level1b;
+    }
+    if (b == Level::level1b) {
+      return a == Level::level1;
+    }
+    return a < b;
+  }
+
+  Level min(Level a, Level b) {
+    return isLess(a, b) ? a : b;
+  }
+
+  // The H264 related fmtp parameters of a codec.
+  struct CodecParameters {
+    // False if the profile-level-id could not be parsed; such a codec
+    // matches nothing.
+    bool valid = true;
+    // Whether the codec had a profile-level-id at all.
+    bool hasProfileLevelId = false;
+    ProfileLevelId profileLevelId;
+    int packetizationMode = 0;
+    bool levelAsymmetryAllowed = false;
+
+    static CodecParameters fromJson(json const& parameters) {
+      CodecParameters result;
+      string profileLevelId = defaultProfileLevelId;
+      if (parameters.is_object()) {
+        auto search = parameters.find("profile-level-id");
+        if (search != parameters.end() && search->is_string()) {
+          result.hasProfileLevelId = true;
+          profileLevelId = search->get<string>();
+        }
+        result.packetizationMode = detail::intParameter(parameters, "packetization-mode", 0);
+        result.levelAsymmetryAllowed = detail::intParameter(parameters, "level-asymmetry-allowed", 0) == 1;
+      }
+      result.valid = parseProfileLevelId(profileLevelId, result.profileLevelId);
+      return result;
+    }
+  };
+
+  bool isSameProfile(CodecParameters const& a, CodecParameters const& b) {
+    return a.valid && b.valid && a.profileLevelId.profile == b.profileLevelId.profile;
+  }
+
+  bool isCompatible(CodecParameters const& a, CodecParameters const& b) {
+    return a.packetizationMode == b.packetizationMode && isSameProfile(a, b);
+  }
+
+  // The profile-level-id to answer with when local receives what remote
+  // offers, or "" if neither side gave one. Both must be compatible.
+  string profileLevelIdForAnswer(CodecParameters const& local, CodecParameters const& remote) {
+    if (!local.hasProfileLevelId && !remote.hasProfileLevelId) {
+      return "";
+    }
+    bool levelAsymmetryAllowed = local.levelAsymmetryAllowed && remote.levelAsymmetryAllowed;
+    ProfileLevelId answer;
+    answer.profile = local.profileLevelId.profile;
+    answer.level = levelAsymmetryAllowed
+      ? local.profileLevelId.level
+      : min(local.profileLevelId.level, remote.profileLevelId.level);
+    return profileLevelIdToString(answer);
+  }
+}
+
+#endif //_H264ProfileLevelId_h_
@@ -18,9 +18,16 @@
 #include "simpleListeners.h"
 #include "sdpUtils.h"
 #include "RemotePlanBSdp.h"
+#include "RemoteUnifiedPlanSdp.h"
+#include "RoomCapabilities.h"
+#include "SdpMunger.h"
+#include "SdpDiff.h"
 #include "WorkQueue.h"
+#include "SignalingProfiler.h"
 #include "log.h"
 
+#include "webrtc/rtc_base/messagehandler.h"
+#include "webrtc/rtc_base/thread.h"
 #include "webrtc/media/engine/webrtcvideocapturerfactory.h"
 #include "webrtc/modules/video_capture/video_capture_factory.h"
 
@@ -63,7 +70,8 @@ std::unique_ptr<cricket::VideoCapturer> OpenVideoCaptureDevice() {
 }
 
 class Handler
-    : public rtc::RefCountInterface
+    : public rtc::RefCountInterface,
+      public rtc::MessageHandler
     // public webrtc::AudioTrackSinkInterface
   {
 
@@ -128,6 +136,11 @@ class Handler
     void OnIceConnectionReceivingChange(bool receiving) override {
       // log(printName() + " OnIceConnectionReceivingChange: " + std::to_string(receiving));
     }
+    // Unified Plan only; Plan B reports remote tracks through OnAddStream.
+    void OnTrack(
+      rtc::scoped_refptr<webrtc::RtpTransceiverInterface> transceiver) override {
+      log(printName() + " OnTrack, " + transceiver->receiver()->track()->id());
+    }
 
     string printName() {
       return "[" + name + "]";
@@ -141,16 +154,42 @@ class Handler
   };
 
   RoomSettings roomSettings;
+  // Compiled from roomSettings by setRoomSettings.
+  std::shared_ptr<const RoomCapabilities> roomCapabilities;
+  // FEC and comfort noise are negotiated when the room supports them.
+  ortc::NegotiationOptions negotiationOptions;
+  // Applied to the descriptions created here before they are set locally.
+  SdpMunger localSdpMunger;
+  // Applied to every remote description before it is set.
+  SdpMunger remoteSdpMunger;
   std::map<int, ConsumerInfo> consumers;
   json remoteReceiveTransportSdp;
+  std::unique_ptr<RecvRemoteSdpInterface> recvRemoteSdp;
   json remoteSendTransportSdp;
   int sendTransportId;
   int receiveTransportId;
   int sendTransportVersion = 0;
+  // Bumped on every successful receive renegotiation.
   int receiveTransportVersion = 0;
+  // The consumers as of the last successful receive renegotiation, which
+  // are the ones recvRemoteSdp holds between renegotiations.
+  std::map<int, ConsumerInfo> negotiatedConsumers;
+  // The receive offer (before munging) and answer last set, to tell what a
+  // new offer changes.
+  string appliedReceiveOffer;
+  string appliedReceiveAnswer;
+  // Only applies to the receive peer connection; the send side is Plan B.
+  webrtc::SdpSemantics receiveSdpSemantics;
 
   WorkQueue workQueue;
 
+  // Consumers added within this many milliseconds of each other are
+  // negotiated together, in one receive renegotiation.
+  int renegotiationWindowMs = 50;
+  // A failed receive renegotiation is tried again this many times, one
+  // renegotiation window later each, before waiting for the next change.
+  int maxRenegotiationRetries = 3;
+
   protected:
   std::shared_ptr<HandlerListener> listener;
   std::shared_ptr<protoo::WebSocketTransport> transport;
@@ -170,19 +209,35 @@ class Handler
   */
 
   public:
-  std::string initialSendOfferSdp;
-  std::string initialReceiveOfferSdp;
+  string initialSendOfferSdp;
+  string initialReceiveOfferSdp;
+
+  // Consumer negotiations queued before this is called (e.g. streamed out of
+  // the join response) start once the receive transport is known.
+  void setRemoteReceiveTransportSdp(json transportSdp) {
+    remoteReceiveTransportSdp = std::move(transportSdp);
+    recvRemoteSdp->setTransportRemoteParameters(remoteReceiveTransportSdp);
+    workQueue.resume();
+  }
 
     Handler(
       // rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> peerConnectionFactory,
       std::shared_ptr<HandlerListener> listener,
-      std::shared_ptr<protoo::WebSocketTransport> transport
+      std::shared_ptr<protoo::WebSocketTransport> transport,
+      webrtc::SdpSemantics receiveSdpSemantics = webrtc::SdpSemantics::kPlanB
     ):
+      receiveSdpSemantics(receiveSdpSemantics),
       // peerConnectionFactory(peerConnectionFactory),
       listener(listener),
       transport(transport)
     {
       receiveTransportId = randomNumber();
+      if (receiveSdpSemantics == webrtc::SdpSemantics::kUnifiedPlan) {
+        recvRemoteSdp.reset(new RecvRemoteUnifiedPlanSdp());
+      } else {
+        recvRemoteSdp.reset(new RecvRemoteSdp());
+      }
+      workQueue.pause();
 
     /*
     auto owned_worker_thread_ = rtc::Thread::Create();
@@ -208,6 +263,24 @@ class Handler
   }
   ~Handler() {
     logError("Destroying the Handler! Much sadness :-(");
+    rtc::Thread::Current()->Clear(this);
+  }
+
+  void OnMessage(rtc::Message* message) override {
+    if (message->message_id == renegotiateReceiveMessage) {
+      renegotiationScheduled = false;
+      queueReceiveRenegotiation();
+    }
+  }
+
+  // The capabilities are compiled here, once per queryRoom or join response;
+  // a response without rtpCapabilities keeps the ones compiled before.
+  void setRoomSettings(RoomSettings settings) {
+    roomSettings = std::move(settings);
+    auto compiled = RoomCapabilities::compile(roomSettings);
+    if (compiled) {
+      roomCapabilities = std::move(compiled);
+    }
   }
 
   void initWebRTC() {
@@ -239,8 +312,12 @@ class Handler
     sendConnectionListener = new rtc::RefCountedObject<SimplePeerObserver>("send", this);
     receiveConnectionListener = new rtc::RefCountedObject<SimplePeerObserver>("receive", this);
 
+    config.sdp_semantics = webrtc::SdpSemantics::kPlanB;
+    auto receiveConfig = config;
+    receiveConfig.sdp_semantics = receiveSdpSemantics;
+
     receivePeerConnection = peerConnectionFactory->CreatePeerConnection(
-        config,
+        receiveConfig,
         &constraints,
         nullptr,
         nullptr,
@@ -272,14 +349,22 @@ class Handler
     }
 
     auto sdpListener = new rtc::RefCountedObject<SimpleCreateSessionDescriptionObserver>("send-createOffer", [&](auto* desc) {
+        desc = mungeLocalDescription(desc, webrtc::SessionDescriptionInterface::kOffer);
         std::string serialized;
-        desc->ToString(&serialized);
+        {
+          PROFILE_STAGE(sdpWrite);
+          desc->ToString(&serialized);
+        }
         initialSendOfferSdp = serialized;
         sendPeerConnection->SetLocalDescription(new rtc::RefCountedObject<SimpleSetSessionDescriptionObserver>("send-setLocal", [&](){
             log("Success: set up send peer connection");
         }), desc);
         log("Room settings: " + roomSettings.dump());
-        auto capabilities = getEffectiveClientRtpCapabilities(serialized, roomSettings);
+        if (!roomCapabilities) {
+          logError("No room capabilities");
+          return;
+        }
+        auto capabilities = getEffectiveClientRtpCapabilities(serialized, *roomCapabilities, negotiationOptions);
         log("Our capabilities: " + capabilities.dump());
         // listener->onRtpCapabilities(serialized);
         listener->onRtpCapabilities(capabilities);
@@ -340,7 +425,10 @@ class Handler
         std::string serialized;
         //desc->ToString(&serialized);
         auto sessionDesc = sendPeerConnection->local_description();
-        sessionDesc->ToString(&serialized);
+        {
+          PROFILE_STAGE(sdpWrite);
+          sessionDesc->ToString(&serialized);
+        }
         // sendPeerConnection->SetLocalDescription(new rtc::RefCountedObject<SimpleSetSessionDescriptionObserver>("send-setLocal", [=](){
             log("Created new offer and set it");
             json request = {
@@ -358,14 +446,18 @@ class Handler
   }
 
   void gotProducerData(json data, std::string kind) {
-    auto remoteSdp = data.at("data").at("sdp").get<string>();
+    auto remoteSdp = remoteSdpMunger.apply(data.at("data").at("sdp").get<string>());
     json rtpParameters = data.at("data").at("rtpParameters");
 
     webrtc::SdpParseError error;
 
-    auto remoteAnswer =
-      webrtc::CreateSessionDescription(webrtc::SessionDescriptionInterface::kAnswer,
-                                       remoteSdp, &error);
+    webrtc::SessionDescriptionInterface* remoteAnswer;
+    {
+      PROFILE_STAGE(sdpParse);
+      remoteAnswer =
+        webrtc::CreateSessionDescription(webrtc::SessionDescriptionInterface::kAnswer,
+                                         remoteSdp, &error);
+    }
 
     sendPeerConnection->SetRemoteDescription(new rtc::RefCountedObject<SimpleSetSessionDescriptionObserver>("send-setRemote", [=](){
 
@@ -409,96 +501,294 @@ class Handler
   }
 
   // bool alreadyAddedUseForTesting = false;
-  void addConsumer(ConsumerInfo consumer) {
+  void addConsumer(JsonView consumer, string const& peerName = "") {
     log(">=>=>=>=> Adding CONSUMER <=<=<=<=<=<=!");
 
-    workQueue.run([=](std::function<void()> cb) {
-      /* just used as a guard to prevent more consumers, during testing
-      if (alreadyAddedUseForTesting) {
-        return;
-      }
-      alreadyAddedUseForTesting = true;
-      */
-
-      // return; // TODO actually add!
-      auto consumerId = consumer.at("id").get<int>();
-      // log("consumerId=" + std::to_string(consumerId));
-      auto kind = consumer.at("kind").get<string>();
-      // log("kind=" + kind);
+    // The consumer is read right away, even if the receive transport is not
+    // there yet and the negotiation below has to wait for it.
+    auto const& consumerFields = *consumer;
+    auto const& rtpParameters = consumerFields.at("rtpParameters");
+    auto consumerId = consumerFields.at("id").get<int>();
+    // log("consumerId=" + std::to_string(consumerId));
+    auto kind = consumerFields.at("kind").get<string>();
+    // log("kind=" + kind);
 
   /*
-      if (kind != "audio") {
-        logError("Kind " + kind + " not supported, skipping.");
-        return;
-      }
+    if (kind != "audio") {
+      logError("Kind " + kind + " not supported, skipping.");
+      return;
+    }
   */
 
-      auto id = consumer.at("id").get<int>();
-      // log("id=" + std::to_string(id));
-      auto trackId = "consumerZZZZZZ-" + kind + "-" + std::to_string(id);
-      auto encoding = consumer.at("rtpParameters").at("encodings").at(0);
-      // log("trackId=" + trackId);
-      auto ssrc = encoding.at("ssrc").get<int>();
-      // log("ssrc=" + std::to_string(ssrc));
-      auto cname = consumer.at("rtpParameters").at("rtcp").at("cname").get<string>();
-      // log("cname=" + cname);
-      json consumerInfo = {
-        {"kind", kind},
-        {"trackId", trackId},
-        {"ssrc", ssrc},
-        {"cname", cname}
-      };
+    auto id = consumerId;
+    // log("id=" + std::to_string(id));
+    auto trackId = "consumerZZZZZZ-" + kind + "-" + std::to_string(id);
+    auto const& encoding = rtpParameters.at("encodings").at(0);
+    // log("trackId=" + trackId);
+    auto ssrc = encoding.at("ssrc").get<uint32_t>();
+    // log("ssrc=" + std::to_string(ssrc));
+    auto const& cname = rtpParameters.at("rtcp").at("cname").get_ref<const string&>();
+    // log("cname=" + cname);
+    ConsumerInfo consumerInfo;
+    if (consumer.count("peerName") > 0) {
+      consumerInfo.peerName = stringPool().intern(consumer.at("peerName").get<string>());
+    } else {
+      consumerInfo.peerName = stringPool().intern(peerName);
+    }
+    consumerInfo.kind = stringPool().intern(kind);
+    consumerInfo.streamId = "recv-stream-" + std::to_string(id);
+    consumerInfo.trackId = trackId;
+    consumerInfo.ssrc = ssrc;
+    consumerInfo.cname = stringPool().intern(cname);
+
+    if (encoding.count("rtx") > 0 && encoding.at("rtx").count("ssrc") > 0) {
+      consumerInfo.rtxSsrc = encoding.at("rtx").at("ssrc").get<uint32_t>();
+    }
+    consumerInfo.rtpParameters = std::make_shared<const RtpParameters>(rtpParameters.get<RtpParameters>());
+
+    /* just used as a guard to prevent more consumers, during testing
+    if (alreadyAddedUseForTesting) {
+      return;
+    }
+    alreadyAddedUseForTesting = true;
+    */
+
+    // It makes it into the offer with the next renegotiation.
+    consumers.emplace(consumerId, consumerInfo);
 
-      if (encoding.count("rtx") > 0 && encoding.at("rtx").count("ssrc") > 0) {
-        consumerInfo.emplace("rtxSsrc", encoding.at("rtx").at("ssrc"));
+    log("ADDING CONSUMER RIGHT OVER HERE");
+    scheduleReceiveRenegotiation();
+  }
+
+  // Returns false if there is no such consumer.
+  bool removeConsumer(int consumerId) {
+    if (consumers.erase(consumerId) == 0) {
+      return false;
+    }
+    scheduleReceiveRenegotiation();
+    return true;
+  }
+
+  void removePeer(string const& peerName) {
+    std::vector<int> consumerIds;
+    for (auto const& entry : consumers) {
+      if (entry.second.peerName.str() == peerName) {
+        consumerIds.push_back(entry.first);
       }
+    }
+    log("Removing " + std::to_string(consumerIds.size()) + " consumers of peer " + peerName);
+    for (auto consumerId : consumerIds) {
+      removeConsumer(consumerId);
+    }
+  }
 
-      consumers.emplace(consumerId, consumerInfo);
+  private:
+  static constexpr uint32_t renegotiateReceiveMessage = 1;
+  // A renegotiation timer is running.
+  bool renegotiationScheduled = false;
+  // A renegotiation task is waiting in the work queue and has not rendered
+  // its offer yet, so later changes will still make it in.
+  bool renegotiationQueued = false;
+  // Receive renegotiations failed in a row.
+  int failedRenegotiations = 0;
+
+  // Starts the coalescing window, unless it is already open.
+  void scheduleReceiveRenegotiation() {
+    if (renegotiationScheduled) {
+      return;
+    }
+    renegotiationScheduled = true;
+    rtc::Thread::Current()->PostDelayed(RTC_FROM_HERE, renegotiationWindowMs, this, renegotiateReceiveMessage);
+  }
 
-      log("ADDING CONSUMER RIGHT OVER HERE");
+  // Consumers added while a negotiation is in flight, or before the receive
+  // transport exists, pile up behind a single queued task.
+  void queueReceiveRenegotiation() {
+    if (renegotiationQueued) {
+      return;
+    }
+    renegotiationQueued = true;
+    workQueue.run([=](std::function<void()> cb) {
+      renegotiationQueued = false;
+      log("Renegotiating the receive transport for " + std::to_string(consumers.size()) + " consumers");
+
+      // Consumers added and removed in the meantime may cancel out.
+      auto delta = diffConsumers(negotiatedConsumers, consumers, receiveTransportVersion + 1);
+      if (delta.empty()) {
+        log("Receive consumers unchanged, not renegotiating");
+        cb();
+        return;
+      }
 
-      json request = {
-        {"method", "newConsumerSdp"},
-        {"initialOfferSdp", initialSendOfferSdp},
-        // {"initialOfferSdp", initialReceiveOfferSdp},
-        {"remoteTransportSdp", remoteReceiveTransportSdp},
-        {"transportId", receiveTransportId},
-        {"version", receiveTransportVersion++},
-        {"consumers", consumers}
-      };
-      transport->request("mediasoup-request", request, std::bind(&Handler::addConsumerWithSdp, this, std::placeholders::_1));
-      cb();
+      // The offer is built here from the consumers, instead of asking the
+      // server for it (newConsumerSdp), so adding a consumer costs no round
+      // trip. Only the m-sections of the consumers in the delta are rendered again.
+      applyToReceiveOffer(delta);
+      string offer = recvRemoteSdp->createOfferSdp();
+      auto diff = SdpDiff::compute(appliedReceiveOffer, offer);
+      if (diff.empty()) {
+        log("Receive offer unchanged, not renegotiating");
+        onReceiveRenegotiated(delta);
+        cb();
+        return;
+      }
+      log("Receive offer changes: " + json(diff).dump());
+
+      // Nothing the answer depends on changed, so the last one is set again
+      // instead of having libwebrtc create (and us munge) a new one.
+      bool reuseAnswer = diff.ssrcsOnly() && !appliedReceiveAnswer.empty();
+      addConsumerWithSdp(offer, [=](bool negotiated) {
+        if (negotiated) {
+          onReceiveRenegotiated(delta);
+        } else {
+          // Back to what was negotiated, so the next renegotiation offers
+          // these changes again.
+          revertReceiveOffer(delta);
+          retryReceiveRenegotiation();
+        }
+        cb();
+      }, reuseAnswer);
     });
   }
 
-  void addConsumerWithSdp(json const sdpResponse) {
-    auto sdp = sdpResponse.at("data").get<string>();
+  void applyToReceiveOffer(ConsumerDelta const& delta) {
+    for (auto const& entry : delta.removed) {
+      recvRemoteSdp->removeConsumer(entry.first);
+    }
+    for (auto const& entry : delta.added) {
+      recvRemoteSdp->addConsumer(entry.first, entry.second);
+    }
+  }
+
+  void revertReceiveOffer(ConsumerDelta const& delta) {
+    for (auto const& entry : delta.added) {
+      recvRemoteSdp->removeConsumer(entry.first);
+    }
+    for (auto const& entry : delta.removed) {
+      recvRemoteSdp->addConsumer(entry.first, entry.second);
+    }
+  }
 
+  // Without a retry, the consumers of a failed renegotiation would only be
+  // offered again when another consumer comes or goes.
+  void retryReceiveRenegotiation() {
+    if (failedRenegotiations >= maxRenegotiationRetries) {
+      logError("Receive renegotiation failed " + std::to_string(failedRenegotiations + 1) +
+               " times, waiting for the next consumer change");
+      failedRenegotiations = 0;
+      return;
+    }
+    failedRenegotiations++;
+    log("Receive renegotiation failed, retry " + std::to_string(failedRenegotiations) +
+        " of " + std::to_string(maxRenegotiationRetries));
+    scheduleReceiveRenegotiation();
+  }
+
+  void onReceiveRenegotiated(ConsumerDelta const& delta) {
+    failedRenegotiations = 0;
+    receiveTransportVersion = delta.version;
+    for (auto const& entry : delta.removed) {
+      negotiatedConsumers.erase(entry.first);
+    }
+    negotiatedConsumers.insert(delta.added.begin(), delta.added.end());
+    log("Receive transport renegotiated: " + json(delta).dump());
+
+    // The removed consumers are out of the local description now, so
+    // libwebrtc has torn down their receive streams and decoders. Peer names
+    // and cnames nothing holds anymore are dropped from the pool (those of
+    // this delta's removed consumers by the next renegotiation).
+    stringPool().collect();
+  }
+
+  public:
+
+  // Runs localSdpMunger over a description libwebrtc created, which is
+  // taken over. Returns it as it is if there is nothing to munge or the
+  // result does not parse.
+  webrtc::SessionDescriptionInterface* mungeLocalDescription(webrtc::SessionDescriptionInterface* desc, const char* type) {
+    if (localSdpMunger.empty()) {
+      return desc;
+    }
+    string sdp;
+    desc->ToString(&sdp);
+
+    webrtc::SdpParseError error;
+    auto munged = webrtc::CreateSessionDescription(type, localSdpMunger.apply(sdp), &error);
+    if (munged == nullptr) {
+      logError("Munged SDP error: " + error.description);
+      return desc;
+    }
+    delete desc;
+    return munged;
+  }
+
+  // Applies a receive offer and answers it; done is called with true once
+  // the answer is set, or with false as soon as a step fails. With
+  // reuseAnswer the last answer set is set again rather than a new one created.
+  void addConsumerWithSdp(string const& sdp, std::function<void(bool)> done, bool reuseAnswer = false) {
+    auto failed = [=]() {
+      done(false);
+    };
     webrtc::SdpParseError error;
 
     log("DO ADD CONSUMER");
 
-    auto remoteOffer =
-      webrtc::CreateSessionDescription(webrtc::SessionDescriptionInterface::kOffer,
-                                       sdp, &error);
+    webrtc::SessionDescriptionInterface* remoteOffer;
+    {
+      PROFILE_STAGE(sdpParse);
+      remoteOffer =
+        webrtc::CreateSessionDescription(webrtc::SessionDescriptionInterface::kOffer,
+                                         remoteSdpMunger.apply(sdp), &error);
+    }
 
     if (error.description != "") {
       logError("SDP error: " + error.description);
-    } else {
-      log("1) Setting remote description");
-      receivePeerConnection->SetRemoteDescription(new rtc::RefCountedObject<SimpleSetSessionDescriptionObserver>("receive-setRemote", [&](){
-        log("2) Remote description set");
-        receivePeerConnection->CreateAnswer(new rtc::RefCountedObject<SimpleCreateSessionDescriptionObserver>("receive-createAnswer",
-          [&](webrtc::SessionDescriptionInterface* answer){
-            log("3) Answer created");
-            receivePeerConnection->SetLocalDescription(
-              new rtc::RefCountedObject<SimpleSetSessionDescriptionObserver>("receive-setLocal", [&](){
-                log("4) Success: consumer added, SDP descriptions set etc.");
-              }),
-            answer);
-          }), nullptr);
-      }), remoteOffer);
+      failed();
+      return;
     }
+
+    log("1) Setting remote description");
+    receivePeerConnection->SetRemoteDescription(new rtc::RefCountedObject<SimpleSetSessionDescriptionObserver>("receive-setRemote", [=](){
+      log("2) Remote description set");
+      auto setAnswer = [=](webrtc::SessionDescriptionInterface* answer, string const& answerSdp) {
+        receivePeerConnection->SetLocalDescription(
+          new rtc::RefCountedObject<SimpleSetSessionDescriptionObserver>("receive-setLocal", [=](){
+            log("4) Success: consumer added, SDP descriptions set etc.");
+            appliedReceiveOffer = sdp;
+            appliedReceiveAnswer = answerSdp;
+            done(true);
+          }, failed),
+        answer);
+      };
+
+      if (reuseAnswer) {
+        webrtc::SdpParseError answerError;
+        webrtc::SessionDescriptionInterface* answer;
+        {
+          PROFILE_STAGE(sdpParse);
+          answer = webrtc::CreateSessionDescription(webrtc::SessionDescriptionInterface::kAnswer,
+                                                    appliedReceiveAnswer, &answerError);
+        }
+        if (answer != nullptr) {
+          log("3) Answer reused");
+          setAnswer(answer, appliedReceiveAnswer);
+          return;
+        }
+        logError("Could not reuse the answer: " + answerError.description);
+      }
+
+      receivePeerConnection->CreateAnswer(new rtc::RefCountedObject<SimpleCreateSessionDescriptionObserver>("receive-createAnswer",
+        [=](webrtc::SessionDescriptionInterface* answer){
+          log("3) Answer created");
+          answer = mungeLocalDescription(answer, webrtc::SessionDescriptionInterface::kAnswer);
+          string answerSdp;
+          {
+            PROFILE_STAGE(sdpWrite);
+            answer->ToString(&answerSdp);
+          }
+          setAnswer(answer, answerSdp);
+        }, failed), nullptr);
+    }, failed), remoteOffer);
   }
 };
 
@@ -0,0 +1,77 @@
+#ifndef _JoinResponseStream_h_
+#define _JoinResponseStream_h_
+
+#include <memory>
+#include <string>
+#include "json.hpp"
+
+using json = nlohmann::json;
+using std::string;
+
+/**
+ * Streams the peers and consumers out of a room join response while it is
+ * being parsed.
+ *
+ * It is a json parser callback for the response "data" object (see
+ * WebSocketTransport::request). Each consumer is handed to the listener as
+ * soon as its closing brace is read and each peer once all of its consumers
+ * are out, and both are then dropped from the document. The response the
+ * request callback finally gets keeps the room settings but an empty "peers"
+ * array, so at most one consumer is held in memory at a time.
+ */
+class JoinResponseReader {
+  public:
+  class Listener {
+    public:
+    // The peer is passed without its consumers, they have been emitted already.
+    virtual void onJoinedPeer(json peer) = 0;
+    virtual void onJoinedConsumer(string const& peerName, json consumer) = 0;
+  };
+
+  private:
+  // Depths are relative to the "data" object: its keys are at depth 1, the
+  // peers at depth 2, peer keys at depth 3 and consumers at depth 4.
+  static constexpr int peerDepth = 2;
+  static constexpr int peerKeyDepth = 3;
+  static constexpr int consumerDepth = 4;
+
+  std::shared_ptr<Listener> listener;
+  string dataKey;
+  string peerKey;
+  string peerName;
+
+  public:
+  JoinResponseReader(std::shared_ptr<Listener> listener)
+    : listener(listener) {}
+
+  bool operator()(int depth, json::parse_event_t event, json& parsed) {
+    if (event == json::parse_event_t::key) {
+      if (depth == 1) {
+        dataKey = parsed.get<string>();
+      } else if (depth == peerKeyDepth) {
+        peerKey = parsed.get<string>();
+      }
+      return true;
+    }
+
+    if (dataKey != "peers") {
+      return true;
+    }
+
+    if (event == json::parse_event_t::object_start && depth == peerDepth) {
+      peerName.clear();
+    } else if (event == json::parse_event_t::value && depth == peerKeyDepth &&
+               peerKey == "name" && parsed.is_string()) {
+      peerName = parsed.get<string>();
+    } else if (event == json::parse_event_t::object_end && depth == consumerDepth && peerKey == "consumers") {
+      listener->onJoinedConsumer(peerName, std::move(parsed));
+      return false;
+    } else if (event == json::parse_event_t::object_end && depth == peerDepth) {
+      listener->onJoinedPeer(std::move(parsed));
+      return false;
+    }
+    return true;
+  }
+};
+
+#endif //_JoinResponseStream_h_
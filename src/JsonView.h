@@ -0,0 +1,114 @@
+#ifndef _JsonView_h_
+#define _JsonView_h_
+
+#include <memory>
+#include <string>
+#include "json.hpp"
+
+using json = nlohmann::json;
+using std::string;
+
+/**
+ * A cheap handle on a subtree of a shared, immutable json document.
+ *
+ * Copying a view (or taking a subtree view with at()) only bumps a reference
+ * count, so signaling payloads like the room join response can be handed from
+ * stage to stage without deep copies. A view is detached into its own document
+ * the first time it is mutated (copy-on-write), so other views never observe
+ * the change.
+ */
+class JsonView {
+  std::shared_ptr<json> document;
+  const json* node;
+
+  JsonView(std::shared_ptr<json> document, const json* node)
+    : document(std::move(document)), node(node) {}
+
+  public:
+  class const_iterator {
+    std::shared_ptr<json> document;
+    json::const_iterator it;
+
+    public:
+    const_iterator(std::shared_ptr<json> document, json::const_iterator it)
+      : document(std::move(document)), it(it) {}
+
+    JsonView operator*() const {
+      return JsonView(document, &(*it));
+    }
+    const_iterator& operator++() {
+      ++it;
+      return *this;
+    }
+    bool operator!=(const const_iterator& other) const {
+      return it != other.it;
+    }
+    bool operator==(const const_iterator& other) const {
+      return it == other.it;
+    }
+    // Only meaningful when iterating over an object.
+    string key() const {
+      return it.key();
+    }
+  };
+
+  JsonView(): JsonView(json()) {}
+
+  // Takes ownership of the value; pass an rvalue to avoid copying it.
+  JsonView(json value)
+    : document(std::make_shared<json>(std::move(value))), node(document.get()) {}
+
+  JsonView at(const string& key) const {
+    return JsonView(document, &node->at(key));
+  }
+  JsonView at(std::size_t index) const {
+    return JsonView(document, &node->at(index));
+  }
+
+  std::size_t count(const string& key) const {
+    return node->count(key);
+  }
+  std::size_t size() const {
+    return node->size();
+  }
+
+  const_iterator begin() const {
+    return const_iterator(document, node->cbegin());
+  }
+  const_iterator end() const {
+    return const_iterator(document, node->cend());
+  }
+
+  template<typename T>
+  T get() const {
+    return node->get<T>();
+  }
+
+  const json& operator*() const {
+    return *node;
+  }
+  const json* operator->() const {
+    return node;
+  }
+
+  string dump() const {
+    return node->dump();
+  }
+
+  // Deep copy of the viewed subtree, for APIs that need to own a json.
+  json materialize() const {
+    return *node;
+  }
+
+  // Returns a mutable reference to the viewed value, detaching this view into
+  // its own document first unless it is the sole owner of the whole document.
+  json& mutate() {
+    if (document.use_count() > 1 || node != document.get()) {
+      document = std::make_shared<json>(*node);
+      node = document.get();
+    }
+    return *document;
+  }
+};
+
+#endif //_JsonView_h_
@@ -4,189 +4,521 @@
 #include "json.hpp"
 #include "request_id.h"
 #include "log.h"
+#include "SignalingProfiler.h"
+#include "SdpScanner.h"
+#include "SdpWriter.h"
+#include "RtpParameters.h"
+#include "RtpRegistry.h"
+#include "TransportParameters.h"
+#include "VoiceChannelData.h"
+
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <vector>
 
 using json = nlohmann::json;
 using std::string;
 
 class RemoteSdp {
   protected:
-  json rtpParametersByKind;
   json transportLocalParameters = nullptr;
-  json transportRemoteParameters = nullptr;
+  TransportRemoteParameters transportRemoteParameters;
+  bool hasTransportRemoteParameters = false;
   int globalId;
   int globalVersion = 0;
+  // Bumped whenever the transport parameters change, which every m-section
+  // depends on.
+  int transportVersion = 0;
+  SdpWriter writer;
+
+  // Rendered text of one m-section, kept until something it depends on
+  // changes so a renegotiation only renders the sections it touches.
+  struct RenderedSection {
+    string text;
+    // Number of times the section has been rendered.
+    int version = 0;
+    int transportVersion = -1;
+    bool dirty = true;
+  };
+
+  // Lines that only depend on the transport, rendered once per
+  // transportVersion and copied into every description and m-section.
+  struct TransportLines {
+    string fingerprint;
+    string ice;
+    int transportVersion = -1;
+  };
+  TransportLines transportLines;
 
   public:
-  RemoteSdp (json rtpParametersByKind)
-    : rtpParametersByKind(rtpParametersByKind)
-    {
-      globalId = randomNumber();
+  RemoteSdp () {
+    globalId = randomNumber();
   }
 
   void setTransportLocalParameters (json transportLocalParameters) {
     this->transportLocalParameters = transportLocalParameters;
   }
 
-  void setTransportRemoteParameters (json transportRemoteParameters) {
-    this->transportRemoteParameters = transportRemoteParameters;
+  void setTransportRemoteParameters (json const& transportRemoteParameters) {
+    this->transportRemoteParameters = transportRemoteParameters.get<TransportRemoteParameters>();
+    hasTransportRemoteParameters = true;
+    transportVersion++;
+  }
+
+  protected:
+  // Renders the section with render() if it is out of date. Must be called
+  // before the description itself is written, as it goes through the writer.
+  template<typename Render>
+  void renderSection (RenderedSection& section, Render render) {
+    if (!section.dirty && section.transportVersion == transportVersion) {
+      return;
+    }
+    writer.reset();
+    render();
+    section.text.assign(writer.str());
+    section.version++;
+    section.transportVersion = transportVersion;
+    section.dirty = false;
+  }
+
+  // Session level lines, for a description bundling the given mids.
+  template<typename Mids>
+  void writeSessionLines (Mids const& mids) {
+    auto const& remoteIceParameters = transportRemoteParameters.iceParameters;
+
+    writer.line('v').add(0).end();
+    writer.line('o').add("mediasoup-client ").add(globalId).add(' ').add(globalVersion).add(" IN IP4 0.0.0.0").end();
+    writer.line('s').add('-').end();
+    writer.line('t').add("0 0").end();
+    if (remoteIceParameters.iceLite) {
+      writer.line('a').add("ice-lite").end();
+    }
+
+    writer.line('a').add("group:BUNDLE");
+    for (auto const& mid : mids) {
+      writer.add(' ').add(mid);
+    }
+    writer.end();
+
+    writer.line('a').add("msid-semantic: WMS *").end();
+    writer.raw(currentTransportLines().fingerprint);
+  }
+
+  void writeIceLines () {
+    writer.raw(currentTransportLines().ice);
+  }
+
+  TransportLines const& currentTransportLines () {
+    if (transportLines.transportVersion == transportVersion) {
+      return transportLines;
+    }
+
+    auto const& remoteIceParameters = transportRemoteParameters.iceParameters;
+    auto const& remoteDtlsParameters = transportRemoteParameters.dtlsParameters;
+    SdpWriter lines;
+
+    if (!remoteDtlsParameters.fingerprints.empty()) {
+      auto const& lastFingerprint = remoteDtlsParameters.fingerprints.back();
+      lines.line('a').add("fingerprint:").add(lastFingerprint.algorithm).add(' ').add(lastFingerprint.value).end();
+    }
+    transportLines.fingerprint = lines.str();
+
+    lines.reset();
+    lines.line('a').add("ice-ufrag:").add(remoteIceParameters.usernameFragment).end();
+    lines.line('a').add("ice-pwd:").add(remoteIceParameters.password).end();
+    for (auto const& candidate : transportRemoteParameters.iceCandidates) {
+      lines.line('a').add("candidate:").add(candidate.foundation).add(" 1 ").add(candidate.protocol)
+        .add(' ').add(candidate.priority).add(' ').add(candidate.ip).add(' ').add(candidate.port)
+        .add(" typ ").add(candidate.type);
+      if (!candidate.tcpType.empty()) {
+        lines.add(" tcptype ").add(candidate.tcpType);
+      }
+      lines.end();
+    }
+    lines.line('a').add("end-of-candidates").end();
+    lines.line('a').add("ice-options:renomination").end();
+    transportLines.ice = lines.str();
+
+    transportLines.transportVersion = transportVersion;
+    return transportLines;
+  }
+
+  void writeMediaLine (string const& kind, std::vector<RtpCodecParameters> const& codecs) {
+    writer.line('m').add(kind).add(" 7 RTP/SAVPF");
+    for (auto const& codec : codecs) {
+      writer.add(' ').add(codec.payloadType);
+    }
+    writer.end();
+    writer.line('c').add("IN IP4 127.0.0.0").end();
+  }
+
+  void writeRtpMapLines (std::vector<RtpCodecParameters> const& codecs) {
+    for (auto const& codec : codecs) {
+      writer.line('a').add("rtpmap:").add(codec.payloadType).add(' ').add(codec.name).add('/').add(codec.clockRate);
+      if (codec.channels > 1) {
+        writer.add('/').add(codec.channels);
+      }
+      writer.end();
+    }
+  }
+
+  void writeRtcpFbLines (std::vector<RtpCodecParameters> const& codecs) {
+    for (auto const& codec : codecs) {
+      for (auto const& fb : codec.rtcpFeedback) {
+        writer.line('a').add("rtcp-fb:").add(codec.payloadType).add(' ').add(fb.type);
+        if (!fb.parameter.empty()) {
+          writer.add(' ').add(fb.parameter);
+        }
+        writer.end();
+      }
+    }
+  }
+
+  void writeFmtpLines (std::vector<RtpCodecParameters> const& codecs) {
+    for (auto const& codec : codecs) {
+      if (codec.parameters.empty()) {
+        continue;
+      }
+      writer.line('a').add("fmtp:").add(codec.payloadType).add(' ');
+      bool first = true;
+      for (auto it = codec.parameters.begin(); it != codec.parameters.end(); ++it) {
+        if (!first) {
+          writer.add(';');
+        }
+        first = false;
+        writer.add(it.key()).add('=');
+        if (it.value().is_string()) {
+          writer.add(it.value().get_ref<const string&>());
+        } else {
+          writer.add(it.value().dump());
+        }
+      }
+      writer.end();
+    }
+  }
+
+  void writeExtmapLines (std::vector<RtpHeaderExtensionParameters> const& headerExtensions) {
+    for (auto const& ext : headerExtensions) {
+      writer.line('a').add("extmap:").add(ext.id).add(' ').add(ext.uri).end();
+    }
+  }
+
+  // Header extensions, minus the MID extension which Plan B does not use.
+  void writeExtmapLinesWithoutMid (std::vector<RtpHeaderExtensionParameters> const& headerExtensions) {
+    for (auto const& ext : headerExtensions) {
+      if (rtpRegistry::findHeaderExtension(ext.uri) == rtpRegistry::HeaderExtensionId::mid) {
+        continue;
+      }
+      writer.line('a').add("extmap:").add(ext.id).add(' ').add(ext.uri).end();
+    }
   }
 };
 
-class SendRemoteSdp : RemoteSdp {
+/**
+ * The send transport's remote answer, for a Plan B local offer.
+ *
+ * Scaffolding: the Handler does not create a send transport on the server
+ * yet, so nothing instantiates this outside of the tests and benchmarks.
+ */
+class SendRemoteSdp : public RemoteSdp {
+  // An answer m-section only depends on the kind and direction of the
+  // matching offer m-section, besides the transport. One of a kind there
+  // are no send parameters for (e.g. application) is rejected, and then
+  // echoes the protocol and formats of the offer instead.
+  struct AnswerSection : RenderedSection {
+    string kind;
+    string direction;
+    bool rejected = false;
+    string protocol;
+    string payloads;
+  };
+
+  RtpParametersByKind rtpParametersByKind;
+  // By mid.
+  std::map<string, AnswerSection> sections;
+
   public:
-  SendRemoteSdp (json rtpParametersByKind): RemoteSdp(rtpParametersByKind) {
+  SendRemoteSdp (json const& rtpParametersByKind)
+    : rtpParametersByKind(rtpParametersByKind.get<RtpParametersByKind>()) {
   }
-  json createAnswerSdp (json localSdpObj) {
+
+  // Renders the remote answer for the given local offer. The returned text
+  // is only valid until the next call.
+  const string& createAnswerSdp (string const& localSdp) {
+    PROFILE_STAGE(sdpWrite);
     if (transportLocalParameters == nullptr) {
       logError("No transport local parameters");
     }
-    if (transportRemoteParameters == nullptr) {
+    if (!hasTransportRemoteParameters) {
       logError("No transport remote parameters");
     }
 
-    auto remoteIceParameters = transportRemoteParameters.at("iceParameters");
-    auto remoteIceCandidates = transportRemoteParameters.at("iceCandidates");
-    auto remoteDtlsParameters = transportRemoteParameters.at("dtlsParameters");
+    auto localSdpObj = sdpScanner::scan(localSdp);
 
-    string midsStr = "";
-    if (localSdpObj.count("media") > 0) {
-      bool first = true;
-      for (auto media : localSdpObj.at("media")) {
-        if (first) {
-          first = false;
-        } else {
-          midsStr += " ";
-        }
-        midsStr += media.at("mid").get<string>();
+    // Increase our SDP version.
+    globalVersion++;
+
+    // All the m-sections, in offer order, and the bundled ones.
+    std::vector<sdpScanner::string_view> mids;
+    std::vector<sdpScanner::string_view> bundleMids;
+    for (auto const& localMediaObj : localSdpObj.media) {
+      mids.push_back(localMediaObj.mid);
+
+      auto& section = sections[localMediaObj.mid.to_string()];
+      bool rejected = rtpParametersByKind.count(localMediaObj.type.to_string()) == 0;
+      if (section.kind != localMediaObj.type || section.direction != localMediaObj.direction ||
+          section.rejected != rejected ||
+          (rejected && (section.protocol != localMediaObj.protocol || section.payloads != localMediaObj.payloads))) {
+        section.kind = localMediaObj.type.to_string();
+        section.direction = localMediaObj.direction.to_string();
+        section.rejected = rejected;
+        section.protocol = rejected ? localMediaObj.protocol.to_string() : string();
+        section.payloads = rejected ? localMediaObj.payloads.to_string() : string();
+        section.dirty = true;
+      }
+      if (rejected) {
+        renderSection(section, [&]() {
+          writeRejectedSection(localMediaObj.mid, section);
+        });
+      } else {
+        bundleMids.push_back(localMediaObj.mid);
+        renderSection(section, [&]() {
+          writeAnswerSection(localMediaObj.mid, section);
+        });
       }
     }
 
+    writer.reset();
+    writeSessionLines(bundleMids);
+    for (auto const& mid : mids) {
+      writer.raw(sections.at(mid.to_string()).text);
+    }
+
+    return writer.str();
+  }
+
+  private:
+  // Port 0 rejects the m-section (RFC 3264); it is left out of the bundle.
+  void writeRejectedSection (sdpScanner::string_view mid, AnswerSection const& section) {
+    writer.line('m').add(section.kind).add(" 0 ").add(section.protocol);
+    if (!section.payloads.empty()) {
+      writer.add(' ').add(section.payloads);
+    }
+    writer.end();
+    writer.line('c').add("IN IP4 127.0.0.0").end();
+    writer.line('a').add("mid:").add(mid).end();
+    writer.line('a').add("inactive").end();
+  }
+
+  // Answers the rtpmap, rtcp-fb, fmtp and extmap lines of the send
+  // parameters, like mediasoup-client does.
+  void writeAnswerSection (sdpScanner::string_view mid, AnswerSection const& section) {
+    auto const& remoteDtlsParameters = transportRemoteParameters.dtlsParameters;
+    auto const& kind = section.kind;
+    auto const& rtpParameters = rtpParametersByKind.at(kind);
+    auto const& codecs = rtpParameters.codecs;
+
+    writeMediaLine(kind, codecs);
+    writeIceLines();
+
+    if (remoteDtlsParameters.role == "client") {
+      writer.line('a').add("setup:active").end();
+    } else if (remoteDtlsParameters.role == "server") {
+      writer.line('a').add("setup:passive").end();
+    }
+
+    writer.line('a').add("mid:").add(mid).end();
+
+    if (section.direction == "sendrecv" || section.direction == "sendonly") {
+      writer.line('a').add("recvonly").end();
+    } else if (section.direction == "recvonly" || section.direction == "inactive") {
+      writer.line('a').add("inactive").end();
+    }
+
+    writer.line('a').add("rtcp-mux").end();
+
+    writeRtpMapLines(codecs);
+    writeRtcpFbLines(codecs);
+    writeFmtpLines(codecs);
+    writeExtmapLinesWithoutMid(rtpParameters.headerExtensions);
+
+    // If video, be ready for simulcast.
+    if (kind == "video") {
+      writer.line('a').add("x-google-flag:conference").end();
+    }
+  }
+};
+
+/**
+ * The receive transport's remote description as the Handler drives it:
+ * RecvRemoteSdp (Plan B) or RecvRemoteUnifiedPlanSdp.
+ */
+class RecvRemoteSdpInterface : public RemoteSdp {
+  public:
+  virtual ~RecvRemoteSdpInterface() {}
+
+  // The consumer must have rtpParameters.
+  virtual void addConsumer (int id, ConsumerInfo const& info) = 0;
+  // Returns false if there is no such consumer.
+  virtual bool removeConsumer (int id) = 0;
+  // Renders the offer for the current consumers. The returned text is only
+  // valid until the next call.
+  virtual const string& createOfferSdp () = 0;
+
+  protected:
+  static RtpParameters const& rtpParametersOf (int id, ConsumerInfo const& info) {
+    if (!info.rtpParameters) {
+      throw std::invalid_argument("No RTP parameters for consumer " + std::to_string(id));
+    }
+    return *info.rtpParameters;
+  }
+
+  void writeSsrcLines (uint32_t ssrc, ConsumerInfo const& info) {
+    writer.line('a').add("ssrc:").add(ssrc).add(" cname:").add(info.cname.str()).end();
+    writer.line('a').add("ssrc:").add(ssrc).add(" msid:").add(info.streamId).add(' ').add(info.trackId).end();
+    writer.line('a').add("ssrc:").add(ssrc).add(" mslabel:").add(info.streamId).end();
+    writer.line('a').add("ssrc:").add(ssrc).add(" label:").add(info.trackId).end();
+  }
+
+  void writeConsumerSsrcLines (ConsumerInfo const& info) {
+    writeSsrcLines(info.ssrc, info);
+    if (info.rtxSsrc != 0) {
+      writeSsrcLines(info.rtxSsrc, info);
+      writer.line('a').add("ssrc-group:FID ").add(info.ssrc).add(' ').add(info.rtxSsrc).end();
+    }
+  }
+};
+
+/**
+ * Builds the Plan B offer for the receive transport locally: one m-section
+ * per kind (mid = kind), with an SSRC block per consumer. Consumers of a kind
+ * may be sent with different codecs (one peer producing VP8, another H264),
+ * so each m-section offers the codecs and header extensions of all of its
+ * consumers' rtpParameters.
+ */
+class RecvRemoteSdp : public RecvRemoteSdpInterface {
+  struct KindSection : RenderedSection {
+    string kind;
+    std::map<int, ConsumerInfo> consumers;
+    // The union of the consumers' codecs (RTX included) and header
+    // extensions. An inactive section keeps those of its last consumers, as
+    // an m-section must still list some codecs.
+    RtpParameters rtpParameters;
+  };
+
+  // In the order their m-sections were first offered, which must not change
+  // across renegotiations.
+  std::vector<KindSection> sections;
+
+  public:
+  RecvRemoteSdp () {}
+
+  void addConsumer (int id, ConsumerInfo const& info) override {
+    rtpParametersOf(id, info);
+    auto& section = sectionFor(info.kind);
+    section.consumers[id] = info;
+    updateRtpParameters(section);
+    section.dirty = true;
+  }
+
+  bool removeConsumer (int id) override {
+    for (auto& section : sections) {
+      if (section.consumers.erase(id) > 0) {
+        updateRtpParameters(section);
+        section.dirty = true;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Only re-renders the m-sections whose consumers changed.
+  const string& createOfferSdp () override {
+    PROFILE_STAGE(sdpWrite);
+    if (!hasTransportRemoteParameters) {
+      logError("No transport remote parameters");
+    }
+
     // Increase our SDP version.
     globalVersion++;
 
-    json iceLite = remoteIceParameters.at("iceLite").get<bool>() ? "ice-lite" : nullptr;
-
-    auto fingerprints = remoteDtlsParameters.at("fingerprints").get<std::vector<json>>();
-    auto lastFingerprint = fingerprints.back();
-
-    json sdpObj = {
-      {"version", 0},
-      {"origin", {
-        {"address", "0.0.0.0"},
-        {"ipVer", 4},
-        {"netType", "IN"},
-        {"sessionId", globalId},
-        {"sessionVersion", globalVersion},
-        {"username", "mediasoup-client"}
-      }},
-      {"name", "-"},
-      {"timing", {
-        {"start", 0},
-        {"stop", 0}
-      }},
-      {"iceLite", iceLite},
-      {"msidSemantic", {
-        {"semantic", "WMS"},
-        {"token", "*"}
-      }},
-      {"groups", {
-        {{"type", {"bundle"}}, {"mids", midsStr}}
-      }},
-      {"media", json::array()},
-      {"fingerprint", {
-        {"type", lastFingerprint.at("algorithm")},
-        {"hash", lastFingerprint.at("value")}
-      }}
-    };
-
-    if (localSdpObj.count("media") > 0) {
-      for (auto &localMediaObj : localSdpObj.at("media")) {
-        auto kind = localMediaObj.at("type").get<string>();
-        auto codecs = rtpParametersByKind.at(kind).at("codecs");
-        auto headerExtensions = rtpParametersByKind.at(kind).at("headerExtensions");
-
-        json remoteMediaObj = {
-          {"type", kind},
-          {"port", 7},
-          {"protocol", "RTP/SAVPF"},
-          {"connection", {
-            {"ip", "127.0.0.0"},
-            {"version", 4}
-          }},
-          {"mid", localMediaObj.at("mid")},
-          {"iceUfrag", remoteIceParameters.at("usernameFragment")},
-          {"icePwd", remoteIceParameters.at("password")},
-          {"candidates", json::array()},
-          {"endOfCandidates", "end-of-candidates"},
-          {"iceOptions", "renomination"},
-          {"rtp", json::array()},
-          {"rtcpFb", json::array()},
-          {"fmtp", json::array()}
-        };
-
-        for (auto &candidate : remoteIceCandidates) {
-          json candidateObj = {
-            {"component", 1},
-            {"foundation", candidate.at("foundation")},
-            {"ip", candidate.at("ip")},
-            {"port", candidate.at("port")},
-            {"priority", candidate.at("priority")},
-            {"transport", candidate.at("protocol")},
-            {"type", candidate.at("type")}
-          };
-          if (candidate.count("tcpType") > 0) {
-            candidateObj.emplace("tcpType", candidate.at("tcpType"));
-          }
-          remoteMediaObj.at("candidates").push_back(candidateObj);
-        }
+    std::vector<sdpScanner::string_view> mids;
+    for (auto& section : sections) {
+      mids.push_back(section.kind);
+      renderSection(section, [&]() {
+        writeOfferSection(section);
+      });
+    }
 
-        if (remoteDtlsParameters.count("role") > 0) {
-          string role = remoteDtlsParameters.at("role");
-          if (role == "client") {
-            remoteMediaObj.emplace("setup", "active");
-          } else if (role == "server") {
-            remoteMediaObj.emplace("setup", "passive");
-          }
-        }
+    writer.reset();
+    writeSessionLines(mids);
+    for (auto const& section : sections) {
+      writer.raw(section.text);
+    }
 
-        if (remoteDtlsParameters.count("direction") > 0) {
-          string direction = remoteDtlsParameters.at("direction");
-          if (direction == "sendrecv" || direction == "recvonly") {
-            remoteMediaObj.emplace("direction", "recvonly");
-          } else if (direction == "recvonly" || direction == "inactive") {
-            remoteMediaObj.emplace("setup", "inactive");
-          }
-        }
+    return writer.str();
+  }
 
-        // If video, be ready for simulcast.
-        if (kind == "video") {
-          remoteMediaObj.emplace("xGoogleFlag", "conference");
-        }
+  private:
+  // The kind's m-section, appended the first time a consumer of it comes.
+  KindSection& sectionFor (string const& kind) {
+    for (auto& section : sections) {
+      if (section.kind == kind) {
+        return section;
+      }
+    }
+    sections.emplace_back();
+    sections.back().kind = kind;
+    return sections.back();
+  }
 
-        for (auto &codec : codecs) {
-          json rtp = {
-            {"payload", codec.at("payloadType")},
-            {"codec", codec.at("name")},
-            {"rate", codec.at("clockRate")}
-          };
-
-          if (codec.at("channels") > 1) {
-            rtp.emplace("encoding", codec.at("channels"));
-          }
-
-          remoteMediaObj.at("rtp").push_back(rtp);
-
-          if (codec.count("parameters") > 0) {
-            json paramFmtp = {
-              {"payload", codec.at("payloadType")},
-              {"config", ""}
-            };
-          }
+  // Rebuilt in consumer order, so the same consumers always give the same
+  // codecs in the same order. A payload type or extension id several
+  // consumers share is only offered once.
+  void updateRtpParameters (KindSection& section) {
+    if (section.consumers.empty()) {
+      return;
+    }
+    RtpParameters merged;
+    std::set<int> payloadTypes;
+    std::set<int> headerExtensionIds;
+    for (auto const& entry : section.consumers) {
+      auto const& rtpParameters = rtpParametersOf(entry.first, entry.second);
+      for (auto const& codec : rtpParameters.codecs) {
+        if (payloadTypes.insert(codec.payloadType).second) {
+          merged.codecs.push_back(codec);
+        }
+      }
+      for (auto const& ext : rtpParameters.headerExtensions) {
+        if (headerExtensionIds.insert(ext.id).second) {
+          merged.headerExtensions.push_back(ext);
         }
       }
     }
+    section.rtpParameters = std::move(merged);
+  }
 
-    return sdpObj;
+  void writeOfferSection (KindSection const& section) {
+    auto const& kind = section.kind;
+    auto const& rtpParameters = section.rtpParameters;
+
+    writeMediaLine(kind, rtpParameters.codecs);
+    writeIceLines();
+    writer.line('a').add("setup:actpass").end();
+    writer.line('a').add("mid:").add(kind).end();
+    writer.line('a').add(section.consumers.empty() ? "inactive" : "sendonly").end();
+    writer.line('a').add("rtcp-mux").end();
+    writer.line('a').add("rtcp-rsize").end();
+
+    writeRtpMapLines(rtpParameters.codecs);
+    writeRtcpFbLines(rtpParameters.codecs);
+    writeFmtpLines(rtpParameters.codecs);
+    writeExtmapLinesWithoutMid(rtpParameters.headerExtensions);
+
+    for (auto const& entry : section.consumers) {
+      writeConsumerSsrcLines(entry.second);
+    }
   }
 };
 #endif
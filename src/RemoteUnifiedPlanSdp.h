@@ -0,0 +1,142 @@
+#ifndef _RemoteUnifiedPlanSdp_h_
+#define _RemoteUnifiedPlanSdp_h_
+
+#include "json.hpp"
+#include "log.h"
+#include "SignalingProfiler.h"
+#include "RemotePlanBSdp.h"
+#include "VoiceChannelData.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+using std::string;
+
+/**
+ * Builds the Unified Plan offer for the receive transport: one m-section
+ * (and so one transceiver) per consumer, offering that consumer's own codecs
+ * and header extensions.
+ *
+ * When a consumer goes away its m-section is kept but turns inactive, and
+ * the next consumer of the same kind takes it over instead of appending a
+ * new one. The description, and the transceivers libwebrtc keeps for it,
+ * thus never grow past the most consumers held at once, no matter how many
+ * peers have come and gone.
+ */
+class RecvRemoteUnifiedPlanSdp : public RecvRemoteSdpInterface {
+  struct ConsumerSection : RenderedSection {
+    string mid;
+    string kind;
+    // -1 while the m-section is inactive, waiting to be reused.
+    int consumerId = -1;
+    ConsumerInfo info;
+    // Those of the consumer, kept while the m-section is inactive, as it
+    // must still list some codecs.
+    std::shared_ptr<const RtpParameters> rtpParameters;
+  };
+
+  // In mid order; m-sections are never removed.
+  std::vector<ConsumerSection> sections;
+  // Consumer id to its index in sections.
+  std::map<int, std::size_t> sectionByConsumer;
+
+  public:
+  RecvRemoteUnifiedPlanSdp () {}
+
+  void addConsumer (int id, ConsumerInfo const& info) override {
+    rtpParametersOf(id, info);
+
+    auto existing = sectionByConsumer.find(id);
+    std::size_t index = existing != sectionByConsumer.end() ? existing->second : findFreeSection(info.kind);
+    if (index == sections.size()) {
+      sections.emplace_back();
+      sections.back().mid = std::to_string(index);
+      sections.back().kind = info.kind;
+    }
+
+    auto& section = sections[index];
+    section.consumerId = id;
+    section.info = info;
+    section.rtpParameters = info.rtpParameters;
+    section.dirty = true;
+    sectionByConsumer[id] = index;
+  }
+
+  bool removeConsumer (int id) override {
+    auto search = sectionByConsumer.find(id);
+    if (search == sectionByConsumer.end()) {
+      return false;
+    }
+    auto& section = sections[search->second];
+    section.consumerId = -1;
+    section.info = ConsumerInfo();
+    section.dirty = true;
+    sectionByConsumer.erase(search);
+    return true;
+  }
+
+  const string& createOfferSdp () override {
+    PROFILE_STAGE(sdpWrite);
+    if (!hasTransportRemoteParameters) {
+      logError("No transport remote parameters");
+    }
+
+    // Increase our SDP version.
+    globalVersion++;
+
+    std::vector<sdpScanner::string_view> mids;
+    for (auto& section : sections) {
+      mids.push_back(section.mid);
+      renderSection(section, [&]() {
+        writeOfferSection(section);
+      });
+    }
+
+    writer.reset();
+    writeSessionLines(mids);
+    for (auto const& section : sections) {
+      writer.raw(section.text);
+    }
+
+    return writer.str();
+  }
+
+  private:
+  // Returns sections.size() if there is no inactive m-section of that kind.
+  std::size_t findFreeSection (string const& kind) {
+    for (std::size_t i = 0; i < sections.size(); i++) {
+      if (sections[i].consumerId == -1 && sections[i].kind == kind) {
+        return i;
+      }
+    }
+    return sections.size();
+  }
+
+  void writeOfferSection (ConsumerSection const& section) {
+    auto const& rtpParameters = *section.rtpParameters;
+    bool active = section.consumerId != -1;
+
+    writeMediaLine(section.kind, rtpParameters.codecs);
+    writeIceLines();
+    writer.line('a').add("setup:actpass").end();
+    writer.line('a').add("mid:").add(section.mid).end();
+    writer.line('a').add(active ? "sendonly" : "inactive").end();
+    writer.line('a').add("rtcp-mux").end();
+    writer.line('a').add("rtcp-rsize").end();
+
+    writeRtpMapLines(rtpParameters.codecs);
+    writeRtcpFbLines(rtpParameters.codecs);
+    writeFmtpLines(rtpParameters.codecs);
+    writeExtmapLines(rtpParameters.headerExtensions);
+
+    if (active) {
+      writer.line('a').add("msid:").add(section.info.streamId).add(' ').add(section.info.trackId).end();
+      writeConsumerSsrcLines(section.info);
+    }
+  }
+};
+
+#endif //_RemoteUnifiedPlanSdp_h_
@@ -0,0 +1,70 @@
+#ifndef _RoomCapabilities_h_
+#define _RoomCapabilities_h_
+
+#include <memory>
+#include <string>
+#include "json.hpp"
+#include "JsonView.h"
+#include "sdpUtils.h"
+
+using json = nlohmann::json;
+using std::string;
+
+/**
+ * The room's rtpCapabilities, compiled once when queryRoom (or join) returns
+ * instead of being walked again for every negotiation: the index
+ * negotiation matches against, and the key the capabilities cache
+ * recognises them by.
+ *
+ * It shares the room settings document rather than copying it, and never
+ * changes once compiled; a new RoomSettings means a new object.
+ *
+ *   auto room = RoomCapabilities::compile(roomSettings);
+ *   auto capabilities = getEffectiveClientRtpCapabilities(localSdp, *room);
+ */
+class RoomCapabilities {
+  JsonView rtpCapabilities;
+  // To key the capabilities cache with.
+  RoomCapabilitiesKey cacheKey;
+  ortc::CapabilitiesIndex index;
+
+  explicit RoomCapabilities(JsonView rtpCapabilities)
+    : rtpCapabilities(std::move(rtpCapabilities)),
+      cacheKey(*this->rtpCapabilities),
+      index(*this->rtpCapabilities) {
+  }
+
+  public:
+  RoomCapabilities(RoomCapabilities const&) = delete;
+  RoomCapabilities& operator=(RoomCapabilities const&) = delete;
+
+  // Returns nullptr if the settings have no rtpCapabilities.
+  static std::shared_ptr<const RoomCapabilities> compile(JsonView const& roomSettings) {
+    if (roomSettings.count("rtpCapabilities") == 0) {
+      return nullptr;
+    }
+    return std::shared_ptr<const RoomCapabilities>(new RoomCapabilities(roomSettings.at("rtpCapabilities")));
+  }
+
+  json const& capabilities() const {
+    return *rtpCapabilities;
+  }
+
+  // Equal for rooms with the same capabilities, even across compiles.
+  RoomCapabilitiesKey const& key() const {
+    return cacheKey;
+  }
+
+  ortc::CapabilitiesIndex const& capabilitiesIndex() const {
+    return index;
+  }
+};
+
+json getEffectiveClientRtpCapabilities(string const& sdp, RoomCapabilities const& room,
+                                       ortc::NegotiationOptions const& options = ortc::NegotiationOptions()) {
+  return getEffectiveClientRtpCapabilities(sdp, room.key(), options, [&](json const& clientCapabilities) {
+    return ortc::getExtendedRtpCapabilities(clientCapabilities, room.capabilities(), room.capabilitiesIndex(), options);
+  });
+}
+
+#endif //_RoomCapabilities_h_
@@ -0,0 +1,80 @@
+#ifndef _RtpParameters_h_
+#define _RtpParameters_h_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+using json = nlohmann::json;
+using std::string;
+
+// Typed RTP parameters, as needed to render SDP m-sections.
+
+struct RtcpFeedback {
+  string type;
+  // Empty when the feedback has no parameter.
+  string parameter;
+};
+
+struct RtpCodecParameters {
+  string name;
+  string mimeType;
+  int payloadType = 0;
+  int clockRate = 0;
+  int channels = 1;
+  // Codec specific parameters (fmtp), as a json object.
+  json parameters = json::object();
+  std::vector<RtcpFeedback> rtcpFeedback;
+};
+
+struct RtpHeaderExtensionParameters {
+  string uri;
+  int id = 0;
+};
+
+struct RtpParameters {
+  std::vector<RtpCodecParameters> codecs;
+  std::vector<RtpHeaderExtensionParameters> headerExtensions;
+};
+
+void from_json(const json& j, RtcpFeedback& feedback) {
+  feedback.type = j.at("type").get<string>();
+  if (j.count("parameter") > 0) {
+    feedback.parameter = j.at("parameter").get<string>();
+  }
+}
+
+void from_json(const json& j, RtpCodecParameters& codec) {
+  codec.name = j.at("name").get<string>();
+  if (j.count("mimeType") > 0) {
+    codec.mimeType = j.at("mimeType").get<string>();
+  }
+  codec.payloadType = j.at("payloadType").get<int>();
+  codec.clockRate = j.at("clockRate").get<int>();
+  if (j.count("channels") > 0) {
+    codec.channels = j.at("channels").get<int>();
+  }
+  if (j.count("parameters") > 0 && j.at("parameters").is_object()) {
+    codec.parameters = j.at("parameters");
+  }
+  if (j.count("rtcpFeedback") > 0) {
+    codec.rtcpFeedback = j.at("rtcpFeedback").get<std::vector<RtcpFeedback>>();
+  }
+}
+
+void from_json(const json& j, RtpHeaderExtensionParameters& ext) {
+  ext.uri = j.at("uri").get<string>();
+  ext.id = j.at("id").get<int>();
+}
+
+void from_json(const json& j, RtpParameters& parameters) {
+  parameters.codecs = j.at("codecs").get<std::vector<RtpCodecParameters>>();
+  if (j.count("headerExtensions") > 0) {
+    parameters.headerExtensions = j.at("headerExtensions").get<std::vector<RtpHeaderExtensionParameters>>();
+  }
+}
+
+using RtpParametersByKind = std::map<string, RtpParameters>;
+
+#endif //_RtpParameters_h_
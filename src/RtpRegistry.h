@@ -0,0 +1,201 @@
+#ifndef _RtpRegistry_h_
+#define _RtpRegistry_h_
+
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
+
+/**
+ * The codecs and header extensions signaling code knows about by name, so
+ * they are compared through a compile-time table instead of string literals
+ * and lowercased copies.
+ *
+ * Names and URIs are looked up case-insensitively by a hash of their ASCII
+ * lowercase form, computed at compile time for the table entries, then
+ * confirmed with a case-insensitive compare. Nothing here allocates.
+ *
+ *   if (rtpRegistry::findCodec(name).id == rtpRegistry::CodecId::rtx) ...
+ */
+namespace rtpRegistry {
+  enum class CodecId : uint8_t {
+    opus,
+    isac,
+    g722,
+    pcmu,
+    pcma,
+    cn,
+    telephoneEvent,
+    vp8,
+    vp9,
+    h264,
+    rtx,
+    red,
+    ulpfec,
+    flexfec,
+    count,
+    unknown = count
+  };
+
+  // What a codec entry is for, beyond carrying media.
+  enum class CodecRole {
+    media,
+    rtx,
+    // red, ulpfec and flexfec-03.
+    fec,
+    // CN
+    comfortNoise,
+    // telephone-event
+    dtmf
+  };
+
+  enum class HeaderExtensionId : uint8_t {
+    mid,
+    audioLevel,
+    toffset,
+    absSendTime,
+    videoOrientation,
+    transportWideCc,
+    playoutDelay,
+    count,
+    unknown = count
+  };
+
+  constexpr char toLower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+  }
+
+  // 32-bit FNV-1a over the ASCII lowercase form of the string, usable at
+  // compile time.
+  constexpr uint32_t hashLower(const char* str, std::size_t length) {
+    uint32_t value = 2166136261u;
+    for (std::size_t i = 0; i < length; i++) {
+      value = (value ^ static_cast<uint8_t>(toLower(str[i]))) * 16777619u;
+    }
+    return value;
+  }
+  static_assert(hashLower("VP8", 3) == hashLower("vp8", 3), "hashLower must ignore case");
+
+  inline uint32_t hashLower(boost::string_view str) {
+    return hashLower(str.data(), str.size());
+  }
+
+  bool equalsIgnoreCase(boost::string_view a, boost::string_view b) {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (std::size_t i = 0; i < a.size(); i++) {
+      if (toLower(a[i]) != toLower(b[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  struct Codec {
+    CodecId id;
+    // As written in SDP rtpmap lines.
+    const char* name;
+    std::size_t length;
+    uint32_t hash;
+    // "" for codecs of either kind.
+    const char* kind;
+    CodecRole role;
+  };
+
+  template<std::size_t N>
+  constexpr Codec makeCodec(CodecId id, const char (&name)[N], const char* kind, CodecRole role) {
+    return { id, name, N - 1, hashLower(name, N - 1), kind, role };
+  }
+
+  // Indexed by CodecId.
+  constexpr Codec codecs[] = {
+    makeCodec(CodecId::opus, "opus", "audio", CodecRole::media),
+    makeCodec(CodecId::isac, "ISAC", "audio", CodecRole::media),
+    makeCodec(CodecId::g722, "G722", "audio", CodecRole::media),
+    makeCodec(CodecId::pcmu, "PCMU", "audio", CodecRole::media),
+    makeCodec(CodecId::pcma, "PCMA", "audio", CodecRole::media),
+    makeCodec(CodecId::cn, "CN", "audio", CodecRole::comfortNoise),
+    makeCodec(CodecId::telephoneEvent, "telephone-event", "audio", CodecRole::dtmf),
+    makeCodec(CodecId::vp8, "VP8", "video", CodecRole::media),
+    makeCodec(CodecId::vp9, "VP9", "video", CodecRole::media),
+    makeCodec(CodecId::h264, "H264", "video", CodecRole::media),
+    makeCodec(CodecId::rtx, "rtx", "", CodecRole::rtx),
+    makeCodec(CodecId::red, "red", "", CodecRole::fec),
+    makeCodec(CodecId::ulpfec, "ulpfec", "", CodecRole::fec),
+    makeCodec(CodecId::flexfec, "flexfec-03", "", CodecRole::fec)
+  };
+  static_assert(sizeof(codecs) / sizeof(Codec) == static_cast<std::size_t>(CodecId::count),
+    "codecs must list every CodecId");
+
+  // For names that are not in the table.
+  constexpr Codec unknownCodec = { CodecId::unknown, "", 0, 0, "", CodecRole::media };
+
+  Codec const& codec(CodecId id) {
+    return id == CodecId::unknown ? unknownCodec : codecs[static_cast<std::size_t>(id)];
+  }
+
+  // By codec name, as in an rtpmap line or a capability's "name".
+  Codec const& findCodec(boost::string_view name) {
+    auto nameHash = hashLower(name);
+    for (auto const& entry : codecs) {
+      if (entry.hash == nameHash && equalsIgnoreCase(boost::string_view(entry.name, entry.length), name)) {
+        return entry;
+      }
+    }
+    return unknownCodec;
+  }
+
+  // By "<kind>/<name>" mimeType; unknown if the kind does not fit the codec.
+  Codec const& findCodecByMimeType(boost::string_view mimeType) {
+    auto slash = mimeType.find('/');
+    if (slash == boost::string_view::npos) {
+      return unknownCodec;
+    }
+    auto const& entry = findCodec(mimeType.substr(slash + 1));
+    if (entry.kind[0] != '\0' && !equalsIgnoreCase(entry.kind, mimeType.substr(0, slash))) {
+      return unknownCodec;
+    }
+    return entry;
+  }
+
+  CodecRole codecRole(boost::string_view name) {
+    return findCodec(name).role;
+  }
+
+  struct HeaderExtension {
+    HeaderExtensionId id;
+    const char* uri;
+    std::size_t length;
+    uint32_t hash;
+  };
+
+  template<std::size_t N>
+  constexpr HeaderExtension makeHeaderExtension(HeaderExtensionId id, const char (&uri)[N]) {
+    return { id, uri, N - 1, hashLower(uri, N - 1) };
+  }
+
+  // Indexed by HeaderExtensionId.
+  constexpr HeaderExtension headerExtensions[] = {
+    makeHeaderExtension(HeaderExtensionId::mid, "urn:ietf:params:rtp-hdrext:sdes:mid"),
+    makeHeaderExtension(HeaderExtensionId::audioLevel, "urn:ietf:params:rtp-hdrext:ssrc-audio-level"),
+    makeHeaderExtension(HeaderExtensionId::toffset, "urn:ietf:params:rtp-hdrext:toffset"),
+    makeHeaderExtension(HeaderExtensionId::absSendTime, "http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time"),
+    makeHeaderExtension(HeaderExtensionId::videoOrientation, "urn:3gpp:video-orientation"),
+    makeHeaderExtension(HeaderExtensionId::transportWideCc,
+      "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01"),
+    makeHeaderExtension(HeaderExtensionId::playoutDelay, "http://www.webrtc.org/experiments/rtp-hdrext/playout-delay")
+  };
+  static_assert(sizeof(headerExtensions) / sizeof(HeaderExtension) == static_cast<std::size_t>(HeaderExtensionId::count),
+    "headerExtensions must list every HeaderExtensionId");
+
+  HeaderExtensionId findHeaderExtension(boost::string_view uri) {
+    auto uriHash = hashLower(uri);
+    for (auto const& entry : headerExtensions) {
+      if (entry.hash == uriHash && equalsIgnoreCase(boost::string_view(entry.uri, entry.length), uri)) {
+        return entry.id;
+      }
+    }
+    return HeaderExtensionId::unknown;
+  }
+}
+
+#endif //_RtpRegistry_h_
@@ -0,0 +1,104 @@
+#ifndef _SdpDiff_h_
+#define _SdpDiff_h_
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <set>
+#include <vector>
+#include "json.hpp"
+#include "SdpScanner.h"
+
+using json = nlohmann::json;
+
+/**
+ * What changed between two versions of a description, as far as
+ * renegotiating it is concerned.
+ *
+ * M-sections are compared by position, since a renegotiation may not
+ * reorder them. SSRCs are compared across the whole description. Lines the
+ * scanner does not pick up (origin, msid, bandwidth...) are not compared.
+ *
+ *   auto diff = SdpDiff::compute(appliedSdp, newSdp);
+ *   if (diff.empty()) { skip } else if (diff.ssrcsOnly()) { cheap path }
+ */
+struct SdpDiff {
+  std::vector<uint32_t> addedSsrcs;
+  std::vector<uint32_t> removedSsrcs;
+  // M-sections added or removed, or with another kind, mid or direction.
+  bool mediaChanged = false;
+  // The m-line payload types, or the rtpmap, fmtp or rtcp-fb lines.
+  bool codecsChanged = false;
+  bool headerExtensionsChanged = false;
+  // ICE credentials or candidates, DTLS fingerprint or setup role.
+  bool transportChanged = false;
+
+  bool ssrcsChanged() const {
+    return !addedSsrcs.empty() || !removedSsrcs.empty();
+  }
+
+  bool empty() const {
+    return !ssrcsChanged() && !mediaChanged && !codecsChanged && !headerExtensionsChanged && !transportChanged;
+  }
+
+  // Only SSRCs came or went, so an answer to the previous description still
+  // fits the new one.
+  bool ssrcsOnly() const {
+    return ssrcsChanged() && !mediaChanged && !codecsChanged && !headerExtensionsChanged && !transportChanged;
+  }
+
+  static SdpDiff compute(sdpScanner::string_view from, sdpScanner::string_view to) {
+    auto fromSession = sdpScanner::scan(from);
+    auto toSession = sdpScanner::scan(to);
+    SdpDiff diff;
+
+    diff.transportChanged = fromSession.transport != toSession.transport;
+    diff.mediaChanged = fromSession.media.size() != toSession.media.size();
+
+    std::set<uint32_t> fromSsrcs;
+    std::set<uint32_t> toSsrcs;
+    for (auto const& media : fromSession.media) {
+      fromSsrcs.insert(media.ssrcs.begin(), media.ssrcs.end());
+    }
+    for (auto const& media : toSession.media) {
+      toSsrcs.insert(media.ssrcs.begin(), media.ssrcs.end());
+    }
+    std::set_difference(toSsrcs.begin(), toSsrcs.end(), fromSsrcs.begin(), fromSsrcs.end(),
+                        std::back_inserter(diff.addedSsrcs));
+    std::set_difference(fromSsrcs.begin(), fromSsrcs.end(), toSsrcs.begin(), toSsrcs.end(),
+                        std::back_inserter(diff.removedSsrcs));
+
+    auto count = std::min(fromSession.media.size(), toSession.media.size());
+    for (std::size_t i = 0; i < count; i++) {
+      auto const& a = fromSession.media[i];
+      auto const& b = toSession.media[i];
+      if (a.type != b.type || a.mid != b.mid || a.direction != b.direction) {
+        diff.mediaChanged = true;
+      }
+      if (a.payloads != b.payloads || a.rtp != b.rtp || a.fmtp != b.fmtp || a.rtcpFb != b.rtcpFb) {
+        diff.codecsChanged = true;
+      }
+      if (a.ext != b.ext) {
+        diff.headerExtensionsChanged = true;
+      }
+      if (a.transport != b.transport || a.port != b.port || a.protocol != b.protocol) {
+        diff.transportChanged = true;
+      }
+    }
+
+    return diff;
+  }
+};
+
+void to_json(json& j, const SdpDiff& diff) {
+  j = {
+    {"added", diff.addedSsrcs},
+    {"removed", diff.removedSsrcs},
+    {"media", diff.mediaChanged},
+    {"codecs", diff.codecsChanged},
+    {"headerExtensions", diff.headerExtensionsChanged},
+    {"transport", diff.transportChanged}
+  };
+}
+
+#endif //_SdpDiff_h_
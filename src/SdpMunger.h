@@ -0,0 +1,243 @@
+#ifndef _SdpMunger_h_
+#define _SdpMunger_h_
+
+#include <sdptransform/sdptransform.hpp>
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "log.h"
+#include "SignalingProfiler.h"
+#include "RtpRegistry.h"
+
+using json = nlohmann::json;
+using std::string;
+
+/**
+ * Ordered list of transforms applied to an SDP before it is handed to
+ * libwebrtc (bitrate caps, codec order, Opus and start bitrate settings,
+ * dropping header extensions...).
+ *
+ * The SDP is parsed into the sdptransform session object once, every stage
+ * edits that object in place, and it is written back once, however many
+ * stages there are. With no stages apply() returns the text as it is,
+ * without parsing it.
+ *
+ *   munger.add("video-cap", sdpMunging::bitrateCap("video", 500));
+ *   auto sdp = munger.apply(offerSdp);
+ */
+class SdpMunger {
+  public:
+  using Transform = std::function<void(json& session)>;
+
+  private:
+  struct Stage {
+    string name;
+    Transform transform;
+    uint64_t calls = 0;
+    uint64_t nanoseconds = 0;
+  };
+
+  std::vector<Stage> stages;
+
+  public:
+  SdpMunger& add(string name, Transform transform) {
+    stages.push_back({ std::move(name), std::move(transform) });
+    return *this;
+  }
+
+  bool empty() const {
+    return stages.empty();
+  }
+
+  string apply(string const& sdp) {
+    if (stages.empty()) {
+      return sdp;
+    }
+
+    json session;
+    {
+      PROFILE_STAGE(sdpParse);
+      session = sdptransform::parse(sdp);
+    }
+
+    for (auto& stage : stages) {
+      auto start = std::chrono::steady_clock::now();
+      stage.transform(session);
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      stage.calls++;
+      stage.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    }
+
+    PROFILE_STAGE(sdpWrite);
+    return sdptransform::write(session);
+  }
+
+  void logTimings() const {
+    for (auto const& stage : stages) {
+      log("SDP munger stage " + stage.name + ": " + std::to_string(stage.calls) + " calls, " +
+          std::to_string(stage.nanoseconds / 1000) + " us");
+    }
+  }
+};
+
+/**
+ * Stock transforms for SdpMunger, on the sdptransform session object.
+ * A kind of "" applies to every m-section.
+ */
+namespace sdpMunging {
+  namespace detail {
+    template<typename Visit>
+    void forEachMedia(json& session, string const& kind, Visit visit) {
+      if (session.count("media") == 0) {
+        return;
+      }
+      for (auto& media : session.at("media")) {
+        if (kind.empty() || media.value("type", "") == kind) {
+          visit(media);
+        }
+      }
+    }
+
+    // Payload types of the rtpmap entries with the given codec name.
+    std::set<int> payloadTypesOf(json const& media, string const& codecName) {
+      std::set<int> payloadTypes;
+      if (media.count("rtp") > 0) {
+        for (auto const& rtp : media.at("rtp")) {
+          if (rtpRegistry::equalsIgnoreCase(rtp.value("codec", ""), codecName)) {
+            payloadTypes.insert(rtp.at("payload").get<int>());
+          }
+        }
+      }
+      return payloadTypes;
+    }
+
+    // Adds or replaces key=value in the fmtp line of a payload type.
+    void setFmtpParameter(json& media, int payloadType, string const& key, string const& value) {
+      if (media.count("fmtp") == 0) {
+        media["fmtp"] = json::array();
+      }
+      for (auto& fmtp : media.at("fmtp")) {
+        if (fmtp.at("payload").get<int>() != payloadType) {
+          continue;
+        }
+        std::vector<string> parameters;
+        auto const& config = fmtp.at("config").get_ref<const string&>();
+        if (!config.empty()) {
+          boost::algorithm::split(parameters, config, boost::is_any_of(";"));
+        }
+        bool replaced = false;
+        for (auto& parameter : parameters) {
+          if (boost::algorithm::starts_with(parameter, key + "=")) {
+            parameter = key + "=" + value;
+            replaced = true;
+          }
+        }
+        if (!replaced) {
+          parameters.push_back(key + "=" + value);
+        }
+        fmtp["config"] = boost::algorithm::join(parameters, ";");
+        return;
+      }
+      media.at("fmtp").push_back({
+        {"payload", payloadType},
+        {"config", key + "=" + value}
+      });
+    }
+  }
+
+  // Caps the m-section bandwidth with b=AS (kbps) and b=TIAS (bps).
+  SdpMunger::Transform bitrateCap(string kind, int kbps) {
+    return [=](json& session) {
+      detail::forEachMedia(session, kind, [&](json& media) {
+        media["bandwidth"] = {
+          {{"type", "AS"}, {"limit", kbps}},
+          {{"type", "TIAS"}, {"limit", kbps * 1000}}
+        };
+      });
+    };
+  }
+
+  // Moves the payload types of the named codec to the front of the m-line.
+  SdpMunger::Transform preferCodec(string kind, string codecName) {
+    return [=](json& session) {
+      detail::forEachMedia(session, kind, [&](json& media) {
+        auto preferred = detail::payloadTypesOf(media, codecName);
+        if (preferred.empty() || media.count("payloads") == 0) {
+          return;
+        }
+        std::vector<string> payloads;
+        auto payloadsString = media.at("payloads").is_string()
+          ? media.at("payloads").get<string>()
+          : std::to_string(media.at("payloads").get<int>());
+        boost::algorithm::split(payloads, payloadsString, boost::is_any_of(" "));
+        std::stable_partition(payloads.begin(), payloads.end(), [&](string const& payload) {
+          return preferred.count(std::atoi(payload.c_str())) > 0;
+        });
+        media["payloads"] = boost::algorithm::join(payloads, " ");
+      });
+    };
+  }
+
+  // Opus stereo and average bitrate (bps); 0 leaves the bitrate alone.
+  SdpMunger::Transform opusSettings(bool stereo, int maxAverageBitrate) {
+    return [=](json& session) {
+      detail::forEachMedia(session, "audio", [&](json& media) {
+        for (auto payloadType : detail::payloadTypesOf(media, "opus")) {
+          detail::setFmtpParameter(media, payloadType, "stereo", stereo ? "1" : "0");
+          detail::setFmtpParameter(media, payloadType, "sprop-stereo", stereo ? "1" : "0");
+          if (maxAverageBitrate > 0) {
+            detail::setFmtpParameter(media, payloadType, "maxaveragebitrate", std::to_string(maxAverageBitrate));
+          }
+        }
+      });
+    };
+  }
+
+  // Bitrate (kbps) libwebrtc starts the video codecs at, before bandwidth
+  // estimation catches up.
+  SdpMunger::Transform startBitrate(int kbps) {
+    return [=](json& session) {
+      detail::forEachMedia(session, "video", [&](json& media) {
+        if (media.count("rtp") == 0) {
+          return;
+        }
+        for (auto const& rtp : media.at("rtp")) {
+          // RTX and FEC streams (red, ulpfec, flexfec-03) follow their media codec.
+          auto role = rtpRegistry::codecRole(rtp.value("codec", ""));
+          if (role == rtpRegistry::CodecRole::rtx || role == rtpRegistry::CodecRole::fec) {
+            continue;
+          }
+          detail::setFmtpParameter(media, rtp.at("payload").get<int>(), "x-google-start-bitrate", std::to_string(kbps));
+        }
+      });
+    };
+  }
+
+  // Drops the header extensions whose URI is not in keep.
+  SdpMunger::Transform keepHeaderExtensions(std::set<string> keep) {
+    return [=](json& session) {
+      detail::forEachMedia(session, "", [&](json& media) {
+        if (media.count("ext") == 0) {
+          return;
+        }
+        auto& extensions = media.at("ext");
+        auto kept = json::array();
+        for (auto& ext : extensions) {
+          if (keep.count(ext.value("uri", "")) > 0) {
+            kept.push_back(std::move(ext));
+          }
+        }
+        extensions = std::move(kept);
+      });
+    };
+  }
+}
+
+#endif //_SdpMunger_h_
@@ -0,0 +1,262 @@
+#ifndef _SdpScanner_h_
+#define _SdpScanner_h_
+
+#include <boost/utility/string_view.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+/**
+ * Single-pass scanner for the parts of an SDP that capability extraction,
+ * answer generation and renegotiation diffs need: m-section metadata, its
+ * rtpmap, fmtp, rtcp-fb and extmap lines, its SSRCs, and the ICE and DTLS
+ * lines at either level.
+ *
+ * Every field is a string_view into the scanned text, so scanning does not
+ * allocate per line; the text must outlive the result. Everything else in
+ * the SDP is skipped. Use sdptransform::parse when the full session object
+ * is needed.
+ */
+namespace sdpScanner {
+  using boost::string_view;
+
+  struct RtpMap {
+    int payload = 0;
+    string_view codec;
+    int rate = 0;
+    // 0 when the rtpmap has no encoding parameters (channels).
+    int encoding = 0;
+  };
+
+  struct Fmtp {
+    int payload = 0;
+    string_view config;
+  };
+
+  struct RtcpFb {
+    // -1 for the "*" wildcard.
+    int payload = 0;
+    string_view type;
+    string_view subtype;
+  };
+
+  struct Extmap {
+    int value = 0;
+    string_view uri;
+  };
+
+  // ICE and DTLS lines, of the session or of an m-section.
+  struct Transport {
+    string_view iceUfrag;
+    string_view icePwd;
+    string_view fingerprint;
+    string_view setup;
+    std::vector<string_view> candidates;
+  };
+
+  struct MediaSection {
+    string_view type;
+    int port = 0;
+    string_view protocol;
+    string_view payloads;
+    string_view mid;
+    string_view direction;
+    std::vector<RtpMap> rtp;
+    std::vector<Fmtp> fmtp;
+    std::vector<RtcpFb> rtcpFb;
+    std::vector<Extmap> ext;
+    // In order of first appearance, each once.
+    std::vector<uint32_t> ssrcs;
+    Transport transport;
+  };
+
+  struct SessionDescription {
+    Transport transport;
+    std::vector<MediaSection> media;
+  };
+
+  bool operator==(RtpMap const& a, RtpMap const& b) {
+    return a.payload == b.payload && a.codec == b.codec && a.rate == b.rate && a.encoding == b.encoding;
+  }
+  bool operator==(Fmtp const& a, Fmtp const& b) {
+    return a.payload == b.payload && a.config == b.config;
+  }
+  bool operator==(RtcpFb const& a, RtcpFb const& b) {
+    return a.payload == b.payload && a.type == b.type && a.subtype == b.subtype;
+  }
+  bool operator==(Extmap const& a, Extmap const& b) {
+    return a.value == b.value && a.uri == b.uri;
+  }
+  bool operator==(Transport const& a, Transport const& b) {
+    return a.iceUfrag == b.iceUfrag && a.icePwd == b.icePwd && a.fingerprint == b.fingerprint &&
+      a.setup == b.setup && a.candidates == b.candidates;
+  }
+  bool operator!=(Transport const& a, Transport const& b) {
+    return !(a == b);
+  }
+
+  // Parses a non-negative decimal integer, returns false if it is not one
+  // or does not fit an int.
+  bool parseInt(string_view str, int& value) {
+    if (str.empty()) {
+      return false;
+    }
+    int64_t result = 0;
+    for (auto c : str) {
+      if (c < '0' || c > '9') {
+        return false;
+      }
+      result = result * 10 + (c - '0');
+      if (result > std::numeric_limits<int>::max()) {
+        return false;
+      }
+    }
+    value = static_cast<int>(result);
+    return true;
+  }
+
+  // Like parseInt, for 32 bit values such as SSRCs.
+  bool parseUint32(string_view str, uint32_t& value) {
+    if (str.empty() || str.size() > 10) {
+      return false;
+    }
+    uint64_t result = 0;
+    for (auto c : str) {
+      if (c < '0' || c > '9') {
+        return false;
+      }
+      result = result * 10 + (c - '0');
+    }
+    if (result > UINT32_MAX) {
+      return false;
+    }
+    value = static_cast<uint32_t>(result);
+    return true;
+  }
+
+  // Splits off the text up to the first separator; str keeps the rest.
+  string_view nextToken(string_view& str, char separator = ' ') {
+    auto end = str.find(separator);
+    auto token = str.substr(0, end);
+    str = end == string_view::npos ? string_view() : str.substr(end + 1);
+    return token;
+  }
+
+  bool startsWith(string_view str, string_view prefix) {
+    return str.size() >= prefix.size() && str.substr(0, prefix.size()) == prefix;
+  }
+
+  void scanTransportAttribute(string_view attribute, Transport& transport) {
+    if (startsWith(attribute, "ice-ufrag:")) {
+      transport.iceUfrag = attribute.substr(10);
+    } else if (startsWith(attribute, "ice-pwd:")) {
+      transport.icePwd = attribute.substr(8);
+    } else if (startsWith(attribute, "fingerprint:")) {
+      transport.fingerprint = attribute.substr(12);
+    } else if (startsWith(attribute, "setup:")) {
+      transport.setup = attribute.substr(6);
+    } else if (startsWith(attribute, "candidate:")) {
+      transport.candidates.push_back(attribute.substr(10));
+    }
+  }
+
+  void scanAttribute(string_view attribute, MediaSection& media) {
+    if (startsWith(attribute, "ssrc:")) {
+      // ssrc:<ssrc> <attribute>; the lines of an SSRC may be interleaved
+      // with those of another (e.g. the RTX one of its FID group).
+      auto rest = attribute.substr(5);
+      uint32_t ssrc;
+      if (parseUint32(nextToken(rest), ssrc) &&
+          std::find(media.ssrcs.begin(), media.ssrcs.end(), ssrc) == media.ssrcs.end()) {
+        media.ssrcs.push_back(ssrc);
+      }
+    } else if (startsWith(attribute, "rtpmap:")) {
+      // rtpmap:<payload> <codec>/<rate>[/<encoding>]
+      auto rest = attribute.substr(7);
+      RtpMap rtp;
+      if (!parseInt(nextToken(rest), rtp.payload)) {
+        return;
+      }
+      rtp.codec = nextToken(rest, '/');
+      if (!parseInt(nextToken(rest, '/'), rtp.rate) || (!rest.empty() && !parseInt(rest, rtp.encoding))) {
+        return;
+      }
+      media.rtp.push_back(rtp);
+    } else if (startsWith(attribute, "fmtp:")) {
+      // fmtp:<payload> <config>
+      auto rest = attribute.substr(5);
+      Fmtp fmtp;
+      if (!parseInt(nextToken(rest), fmtp.payload)) {
+        return;
+      }
+      fmtp.config = rest;
+      media.fmtp.push_back(fmtp);
+    } else if (startsWith(attribute, "rtcp-fb:")) {
+      // rtcp-fb:<payload|*> <type>[ <subtype>]
+      auto rest = attribute.substr(8);
+      RtcpFb fb;
+      auto payload = nextToken(rest);
+      if (payload == "*") {
+        fb.payload = -1;
+      } else if (!parseInt(payload, fb.payload)) {
+        return;
+      }
+      fb.type = nextToken(rest);
+      fb.subtype = rest;
+      media.rtcpFb.push_back(fb);
+    } else if (startsWith(attribute, "extmap:")) {
+      // extmap:<value>[/<direction>] <uri>[ <attributes>]
+      auto rest = attribute.substr(7);
+      auto value = nextToken(rest);
+      Extmap ext;
+      if (!parseInt(nextToken(value, '/'), ext.value)) {
+        return;
+      }
+      ext.uri = nextToken(rest);
+      media.ext.push_back(ext);
+    } else if (startsWith(attribute, "mid:")) {
+      media.mid = attribute.substr(4);
+    } else if (attribute == "sendrecv" || attribute == "sendonly" ||
+               attribute == "recvonly" || attribute == "inactive") {
+      media.direction = attribute;
+    } else {
+      scanTransportAttribute(attribute, media.transport);
+    }
+  }
+
+  SessionDescription scan(string_view sdp) {
+    SessionDescription session;
+    MediaSection* media = nullptr;
+
+    while (!sdp.empty()) {
+      auto line = nextToken(sdp, '\n');
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+      }
+      if (line.size() < 2 || line[1] != '=') {
+        continue;
+      }
+
+      if (line[0] == 'm') {
+        // m=<type> <port> <protocol> <payloads>
+        auto rest = line.substr(2);
+        session.media.emplace_back();
+        media = &session.media.back();
+        media->type = nextToken(rest);
+        parseInt(nextToken(rest), media->port);
+        media->protocol = nextToken(rest);
+        media->payloads = rest;
+      } else if (line[0] == 'a' && media != nullptr) {
+        scanAttribute(line.substr(2), *media);
+      } else if (line[0] == 'a') {
+        scanTransportAttribute(line.substr(2), session.transport);
+      }
+    }
+
+    return session;
+  }
+}
+
+#endif //_SdpScanner_h_
@@ -0,0 +1,68 @@
+#ifndef _SdpWriter_h_
+#define _SdpWriter_h_
+
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
+#include <string>
+
+/**
+ * Renders SDP text line by line into a buffer that is kept between uses, so
+ * generating a description does not go through a json session object and
+ * sdptransform::write, and reuses the previous allocation.
+ *
+ *   writer.line('a').add("mid:").add(mid).end();
+ */
+class SdpWriter {
+  std::string buffer;
+
+  public:
+  // Starts a new description, keeping the buffer's capacity.
+  void reset() {
+    buffer.clear();
+  }
+
+  SdpWriter& line(char type) {
+    buffer += type;
+    buffer += '=';
+    return *this;
+  }
+
+  SdpWriter& add(boost::string_view str) {
+    buffer.append(str.data(), str.size());
+    return *this;
+  }
+
+  SdpWriter& add(char c) {
+    buffer += c;
+    return *this;
+  }
+
+  SdpWriter& add(int64_t value) {
+    buffer += std::to_string(value);
+    return *this;
+  }
+
+  SdpWriter& add(int value) {
+    return add(static_cast<int64_t>(value));
+  }
+
+  SdpWriter& add(uint32_t value) {
+    return add(static_cast<int64_t>(value));
+  }
+
+  SdpWriter& end() {
+    buffer += "\r\n";
+    return *this;
+  }
+
+  // Appends already rendered SDP lines.
+  SdpWriter& raw(boost::string_view lines) {
+    return add(lines);
+  }
+
+  const std::string& str() const {
+    return buffer;
+  }
+};
+
+#endif //_SdpWriter_h_
@@ -0,0 +1,272 @@
+#ifndef _SignalingProfiler_h_
+#define _SignalingProfiler_h_
+
+/**
+ * Allocation and time counters per signaling stage.
+ *
+ * Build with -DMEDIASOUP_PROFILE=ON to enable. Code marks the stage it is in
+ * with PROFILE_STAGE(name); every heap allocation made on that thread while
+ * the stage is active is attributed to it (nested stages take precedence),
+ * along with the wall time spent in the stage. Time is exclusive like
+ * allocations: a nested stage's time is taken out of the stage around it, so
+ * the rows add up to the total. signalingProfiler::report() logs the table
+ * on demand, and it is logged once more at shutdown.
+ *
+ * When the option is off, PROFILE_STAGE expands to nothing and report() is a
+ * no-op, so the hooks cost nothing in regular builds.
+ */
+
+#ifdef MEDIASOUP_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "log.h"
+
+namespace signalingProfiler {
+  enum class Stage : uint8_t {
+    none,
+    parse,
+    dispatch,
+    sdpUtils,
+    sdpParse,
+    sdpWrite,
+    // ortc::getExtendedRtpCapabilities
+    extendedCaps,
+    // ortc::getRtpCapabilities
+    rtpCaps,
+    dump,
+    count
+  };
+
+  const char* stageName(Stage stage) {
+    switch (stage) {
+      case Stage::none: return "(other)";
+      case Stage::parse: return "parse";
+      case Stage::dispatch: return "dispatch";
+      case Stage::sdpUtils: return "sdpUtils";
+      case Stage::sdpParse: return "sdpParse";
+      case Stage::sdpWrite: return "sdpWrite";
+      case Stage::extendedCaps: return "extendedCaps";
+      case Stage::rtpCaps: return "rtpCaps";
+      case Stage::dump: return "dump";
+      default: return "?";
+    }
+  }
+
+  struct StageCounters {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> nanoseconds{0};
+  };
+
+  StageCounters counters[static_cast<std::size_t>(Stage::count)];
+  thread_local Stage currentStage = Stage::none;
+
+  void countAllocation(std::size_t size) {
+    auto& stageCounters = counters[static_cast<std::size_t>(currentStage)];
+    stageCounters.allocations.fetch_add(1, std::memory_order_relaxed);
+    stageCounters.bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+
+  class ScopedStage;
+  thread_local ScopedStage* currentScope = nullptr;
+
+  class ScopedStage {
+    Stage stage;
+    Stage previousStage;
+    ScopedStage* parent;
+    std::chrono::steady_clock::time_point start;
+    // Time spent in stages nested in this one, not counted towards it.
+    uint64_t childNanoseconds = 0;
+
+    public:
+    explicit ScopedStage(Stage stage)
+      : stage(stage), previousStage(currentStage), parent(currentScope), start(std::chrono::steady_clock::now()) {
+      currentStage = stage;
+      currentScope = this;
+    }
+    ~ScopedStage() {
+      uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+      auto& stageCounters = counters[static_cast<std::size_t>(stage)];
+      stageCounters.calls.fetch_add(1, std::memory_order_relaxed);
+      stageCounters.nanoseconds.fetch_add(elapsed - childNanoseconds, std::memory_order_relaxed);
+      if (parent) {
+        parent->childNanoseconds += elapsed;
+      }
+      currentStage = previousStage;
+      currentScope = parent;
+    }
+  };
+
+  void report() {
+    log("Signaling profile (stage: calls, allocations, bytes, exclusive ms):");
+    uint64_t totalNanoseconds = 0;
+    char line[160];
+    for (std::size_t i = 0; i < static_cast<std::size_t>(Stage::count); i++) {
+      auto const& stageCounters = counters[i];
+      totalNanoseconds += stageCounters.nanoseconds.load();
+      std::snprintf(line, sizeof(line), "  %-12s %8llu %10llu %12llu %10.3f",
+        stageName(static_cast<Stage>(i)),
+        static_cast<unsigned long long>(stageCounters.calls.load()),
+        static_cast<unsigned long long>(stageCounters.allocations.load()),
+        static_cast<unsigned long long>(stageCounters.bytes.load()),
+        stageCounters.nanoseconds.load() / 1e6);
+      log(line);
+    }
+    std::snprintf(line, sizeof(line), "  %-12s %43.3f", "total", totalNanoseconds / 1e6);
+    log(line);
+  }
+
+  struct ReportAtShutdown {
+    ~ReportAtShutdown() {
+      report();
+    }
+  } reportAtShutdown;
+}
+
+#if defined(__GNUC__)
+#define PROFILE_NOINLINE __attribute__((noinline))
+#else
+#define PROFILE_NOINLINE
+#endif
+
+namespace signalingProfiler {
+  // Every operator new below allocates through here and every operator
+  // delete frees through release(), so any new can be paired with any
+  // delete. Neither is inlined, or the compiler would see free() called on
+  // what operator new returned and warn (-Wmismatched-new-delete).
+  PROFILE_NOINLINE void* allocate(std::size_t size, std::size_t alignment) noexcept {
+    countAllocation(size);
+    if (size == 0) {
+      size = 1;
+    }
+    if (alignment <= alignof(std::max_align_t)) {
+      return std::malloc(size);
+    }
+    void* memory = nullptr;
+    return posix_memalign(&memory, alignment, size) == 0 ? memory : nullptr;
+  }
+
+  PROFILE_NOINLINE void release(void* memory) noexcept {
+    std::free(memory);
+  }
+
+  void* allocateOrThrow(std::size_t size, std::size_t alignment) {
+    if (void* memory = allocate(size, alignment)) {
+      return memory;
+    }
+    throw std::bad_alloc();
+  }
+}
+
+void* operator new(std::size_t size) {
+  return signalingProfiler::allocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size) {
+  return signalingProfiler::allocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept {
+  return signalingProfiler::allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept {
+  return signalingProfiler::allocate(size, alignof(std::max_align_t));
+}
+
+void operator delete(void* memory) noexcept {
+  signalingProfiler::release(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+  signalingProfiler::release(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+  signalingProfiler::release(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+  signalingProfiler::release(memory);
+}
+
+void operator delete(void* memory, std::nothrow_t const&) noexcept {
+  signalingProfiler::release(memory);
+}
+
+void operator delete[](void* memory, std::nothrow_t const&) noexcept {
+  signalingProfiler::release(memory);
+}
+
+// Over-aligned types, when the compiler supports allocating them (C++17 or
+// -faligned-new).
+#ifdef __cpp_aligned_new
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return signalingProfiler::allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return signalingProfiler::allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept {
+  return signalingProfiler::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept {
+  return signalingProfiler::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+  signalingProfiler::release(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+  signalingProfiler::release(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+  signalingProfiler::release(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept {
+  signalingProfiler::release(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, std::nothrow_t const&) noexcept {
+  signalingProfiler::release(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, std::nothrow_t const&) noexcept {
+  signalingProfiler::release(memory);
+}
+
+#endif //__cpp_aligned_new
+
+#define PROFILE_STAGE_CONCAT_INNER(a, b) a##b
+#define PROFILE_STAGE_CONCAT(a, b) PROFILE_STAGE_CONCAT_INNER(a, b)
+#define PROFILE_STAGE(stage) \
+  signalingProfiler::ScopedStage PROFILE_STAGE_CONCAT(profileStage, __LINE__)(signalingProfiler::Stage::stage)
+
+#else
+
+namespace signalingProfiler {
+  void report() {}
+}
+
+#define PROFILE_STAGE(stage)
+
+#endif //MEDIASOUP_PROFILE
+
+#endif //_SignalingProfiler_h_
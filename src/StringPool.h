@@ -0,0 +1,132 @@
+#ifndef _StringPool_h_
+#define _StringPool_h_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include "json.hpp"
+#include "log.h"
+
+using json = nlohmann::json;
+using std::string;
+
+/**
+ * Refcounted handle on an immutable string stored once in the process-wide
+ * StringPool. Copies share the same storage.
+ */
+class PooledString {
+  std::shared_ptr<const string> value;
+
+  public:
+  PooledString();
+  explicit PooledString(std::shared_ptr<const string> value): value(std::move(value)) {}
+
+  const string& str() const {
+    return *value;
+  }
+  operator const string&() const {
+    return *value;
+  }
+  bool empty() const {
+    return value->empty();
+  }
+  bool operator==(const PooledString& other) const {
+    // Equal strings are interned to the same storage.
+    return value == other.value;
+  }
+  bool operator!=(const PooledString& other) const {
+    return value != other.value;
+  }
+};
+
+void to_json(json& j, const PooledString& str) {
+  j = str.str();
+}
+
+/**
+ * Interns the few distinct values that many consumers repeat (kinds, peer
+ * names, cnames), so each is stored once per process no matter how many
+ * places hold it. Values unique to one consumer or request, such as track
+ * ids or SDP blobs, gain nothing from it and are kept as plain strings.
+ *
+ * Strings stay in the pool while any PooledString refers to them; collect()
+ * drops the ones nobody holds anymore.
+ */
+class StringPool {
+  struct Hash {
+    std::size_t operator()(const std::shared_ptr<const string>& str) const {
+      return std::hash<string>()(*str);
+    }
+  };
+  struct Equal {
+    bool operator()(const std::shared_ptr<const string>& a, const std::shared_ptr<const string>& b) const {
+      return *a == *b;
+    }
+  };
+
+  std::unordered_set<std::shared_ptr<const string>, Hash, Equal> strings;
+  std::mutex mutex;
+
+  public:
+  struct Stats {
+    std::size_t strings = 0;
+    // Bytes actually stored by the pool.
+    std::size_t storedBytes = 0;
+    // Bytes all live references would take if each held its own copy.
+    std::size_t referencedBytes = 0;
+  };
+
+  PooledString intern(const string& str) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Look up through a non-owning pointer, so hits do not copy the string.
+    auto search = strings.find(std::shared_ptr<const string>(std::shared_ptr<const string>(), &str));
+    if (search != strings.end()) {
+      return PooledString(*search);
+    }
+    auto stored = std::make_shared<const string>(str);
+    strings.insert(stored);
+    return PooledString(stored);
+  }
+
+  // Drops the strings that are only referenced by the pool itself.
+  void collect() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = strings.begin(); it != strings.end();) {
+      if (it->use_count() == 1) {
+        it = strings.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  Stats stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats;
+    for (auto const& str : strings) {
+      stats.strings++;
+      stats.storedBytes += str->size();
+      stats.referencedBytes += str->size() * (str.use_count() - 1);
+    }
+    return stats;
+  }
+
+  void report() {
+    auto current = stats();
+    auto saved = current.referencedBytes > current.storedBytes ? current.referencedBytes - current.storedBytes : 0;
+    log("String pool: " + std::to_string(current.strings) + " strings, " +
+        std::to_string(current.storedBytes) + " bytes stored for " +
+        std::to_string(current.referencedBytes) + " bytes referenced (" +
+        std::to_string(saved) + " bytes saved)");
+  }
+};
+
+StringPool& stringPool() {
+  static StringPool pool;
+  return pool;
+}
+
+PooledString::PooledString(): PooledString(stringPool().intern("")) {}
+
+#endif //_StringPool_h_
@@ -0,0 +1,83 @@
+#ifndef _TransportParameters_h_
+#define _TransportParameters_h_
+
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+using json = nlohmann::json;
+using std::string;
+
+// Typed view of the transport data mediasoup returns from createTransport.
+
+struct IceParameters {
+  string usernameFragment;
+  string password;
+  bool iceLite = false;
+};
+
+struct IceCandidate {
+  string foundation;
+  string ip;
+  int port = 0;
+  uint32_t priority = 0;
+  string protocol;
+  string type;
+  // Empty for UDP candidates.
+  string tcpType;
+};
+
+struct DtlsFingerprint {
+  string algorithm;
+  string value;
+};
+
+struct DtlsParameters {
+  // "auto", "client" or "server"; empty if not given.
+  string role;
+  std::vector<DtlsFingerprint> fingerprints;
+};
+
+struct TransportRemoteParameters {
+  IceParameters iceParameters;
+  std::vector<IceCandidate> iceCandidates;
+  DtlsParameters dtlsParameters;
+};
+
+void from_json(const json& j, IceParameters& ice) {
+  ice.usernameFragment = j.at("usernameFragment").get<string>();
+  ice.password = j.at("password").get<string>();
+  ice.iceLite = j.count("iceLite") > 0 && j.at("iceLite").get<bool>();
+}
+
+void from_json(const json& j, IceCandidate& candidate) {
+  candidate.foundation = j.at("foundation").get<string>();
+  candidate.ip = j.at("ip").get<string>();
+  candidate.port = j.at("port").get<int>();
+  candidate.priority = j.at("priority").get<uint32_t>();
+  candidate.protocol = j.at("protocol").get<string>();
+  candidate.type = j.at("type").get<string>();
+  if (j.count("tcpType") > 0) {
+    candidate.tcpType = j.at("tcpType").get<string>();
+  }
+}
+
+void from_json(const json& j, DtlsFingerprint& fingerprint) {
+  fingerprint.algorithm = j.at("algorithm").get<string>();
+  fingerprint.value = j.at("value").get<string>();
+}
+
+void from_json(const json& j, DtlsParameters& dtls) {
+  if (j.count("role") > 0) {
+    dtls.role = j.at("role").get<string>();
+  }
+  dtls.fingerprints = j.at("fingerprints").get<std::vector<DtlsFingerprint>>();
+}
+
+void from_json(const json& j, TransportRemoteParameters& parameters) {
+  parameters.iceParameters = j.at("iceParameters").get<IceParameters>();
+  parameters.iceCandidates = j.at("iceCandidates").get<std::vector<IceCandidate>>();
+  parameters.dtlsParameters = j.at("dtlsParameters").get<DtlsParameters>();
+}
+
+#endif //_TransportParameters_h_
@@ -12,6 +12,7 @@
 #include "log.h"
 #include "VoiceChannelData.h"
 #include "request_id.h"
+#include "JoinResponseStream.h"
 
 #include <string>
 
@@ -21,7 +22,8 @@ namespace ssl = boost::asio::ssl;
 class VoiceChannel
   : public protoo::WebSocketTransport::TransportListener,
     public std::enable_shared_from_this<VoiceChannel>,
-    public Handler::HandlerListener
+    public Handler::HandlerListener,
+    public JoinResponseReader::Listener
     {
 
   string peerName;
@@ -37,7 +39,9 @@ class VoiceChannel
     string const host,
     string const port,
     string const roomId,
-    string const peerName
+    string const peerName,
+    // Unified Plan maps each consumer to its own transceiver.
+    webrtc::SdpSemantics receiveSdpSemantics = webrtc::SdpSemantics::kPlanB
   ): peerName(peerName), ioc(ioc) {
     log("Init SSL");
     // for WebRTC
@@ -60,7 +64,7 @@ class VoiceChannel
 
     // auto pcFactory = webrtc::CreatePeerConnectionFactory();
 
-    this->handler = new rtc::RefCountedObject<Handler>(shared_from_this(), transport);
+    this->handler = new rtc::RefCountedObject<Handler>(shared_from_this(), transport, receiveSdpSemantics);
   }
 
   void joinRoom() {
@@ -81,11 +85,17 @@ class VoiceChannel
   }
   void onTransportClose() override {
     log("Transport closed!");
+    signalingProfiler::report();
+    stringPool().report();
+    rtpCapabilitiesCache().report();
+    transport->logTrafficStats();
+    handler->localSdpMunger.logTimings();
+    handler->remoteSdpMunger.logTimings();
   }
   void onNotification(json const notification) override {
     log("On notification " + notification.dump());
   }
-  void handleRequest(json const request) override {
+  void handleRequest(json request) override {
     auto requestId = request.at("id").get<int>();
 
     string method;
@@ -98,27 +108,37 @@ class VoiceChannel
       dataMethod = request.at("data").at("method").get<string>();
     }
 
+    // Peers and consumers are handed on as views into the request, not copies.
+    JsonView requestView(std::move(request));
+
     if (dataMethod == "newPeer") {
-      handlePeer(request.at("data"));
+      handlePeer(requestView.at("data"));
       respondOK(requestId);
     } else if (dataMethod == "newConsumer") {
-      addConsumer(request.at("data"));
+      addConsumer(requestView.at("data"));
       respondOK(requestId);
     } else if (dataMethod == "peerClosed") {
-      log("Peer left: " + request.at("data").at("name").get<string>());
+      auto name = requestView.at("data").at("name").get<string>();
+      log("Peer left: " + name);
+      handler->removePeer(name);
+      respondOK(requestId);
+    } else if (dataMethod == "consumerClosed") {
+      auto consumerId = requestView.at("data").at("id").get<int>();
+      log("Consumer closed: " + std::to_string(consumerId));
+      handler->removeConsumer(consumerId);
       respondOK(requestId);
     } else if (dataMethod == "consumerPreferredProfileSet") {
       log("Consumer set preferred profile on server - ignore");
       respondOK(requestId);
     } else if (method == "active-speaker") {
       string activeSpeaker;
-      if (request.at("data").count("peerName") > 0 && request.at("data").at("peerName").is_string()) {
-        activeSpeaker = request.at("data").at("peerName").get<string>();
+      if (requestView.at("data").count("peerName") > 0 && requestView.at("data").at("peerName")->is_string()) {
+        activeSpeaker = requestView.at("data").at("peerName").get<string>();
       }
       log("Active speaker: " + activeSpeaker);
       respondOK(requestId);
     } else {
-      log("Could not understand the request: " + request.dump());
+      log("Could not understand the request: " + requestView.dump());
       this->transport->send({
         {"response", true},
         {"id", requestId},
@@ -135,9 +155,9 @@ class VoiceChannel
     });
   }
 
-  void initWebRTC(json const roomSettings) {
-    log("Init WebRTC here! Got room settings: " + roomSettings.at("data").dump());
-    handler->roomSettings = roomSettings.at("data");
+  void initWebRTC(json response) {
+    handler->setRoomSettings(JsonView(std::move(response)).at("data"));
+    log("Init WebRTC here! Got room settings: " + handler->roomSettings.dump());
     handler->initWebRTC();
   }
 
@@ -156,10 +176,21 @@ class VoiceChannel
       {"target", "room"},
       {"peerName", peerName},
       {"rtpCapabilities", nativeCapabilities}
-    }, std::bind(&VoiceChannel::onRoomJoin, shared_from_this(), std::placeholders::_1));
+    },
+    std::bind(&VoiceChannel::onRoomJoin, shared_from_this(), std::placeholders::_1),
+    JoinResponseReader(shared_from_this()));
   };
 
-  void onRoomJoin(json const response) {
+  // Called while the join response is still being parsed.
+  void onJoinedPeer(json peer) override {
+    log("Joined peer " + peer.at("name").get<string>());
+  }
+
+  void onJoinedConsumer(string const& peerName, json consumer) override {
+    handler->addConsumer(JsonView(std::move(consumer)), peerName);
+  }
+
+  void onRoomJoin(json response) {
     // ok, let's assume that we joined the room
     bool isOk = response.count("ok") > 0 && response.at("ok").get<bool>();
     if (!isOk) {
@@ -167,9 +198,13 @@ class VoiceChannel
       return;
     }
 
-    handler->roomSettings = response.at("data");
+    // The room settings and the peer list share the response document. The
+    // peers have normally been streamed out already while parsing, so this is
+    // empty unless the response did not come in the expected order.
+    auto data = JsonView(std::move(response)).at("data");
+    handler->setRoomSettings(data);
 
-    auto peers = response.at("data").at("peers");
+    auto peers = data.at("peers");
 
     log("Room join OK!");
 
@@ -188,10 +223,9 @@ class VoiceChannel
     }, std::bind(&VoiceChannel::onReceiveTransportCreated, shared_from_this(), peers, std::placeholders::_1));
   }
 
-  void onReceiveTransportCreated(json peers, json response) {
+  void onReceiveTransportCreated(JsonView peers, json response) {
     log("----> Receive transport!");
-    auto remoteTransportSdp = response.at("data");
-    handler->remoteReceiveTransportSdp = remoteTransportSdp;
+    handler->setRemoteReceiveTransportSdp(std::move(response.at("data")));
 
     for(auto const& peer: peers) {
       log("Handle peer " + peer.dump());
@@ -225,14 +259,14 @@ class VoiceChannel
     handler->remoteSendTransportSdp = remoteTransportSdp;
   }
 
-  void handlePeer(json const peer) {
-    auto consumers = peer.at("consumers");
-    for(auto const& consumer: consumers) {
-      addConsumer(consumer);
+  void handlePeer(JsonView const peer) {
+    auto name = peer.at("name").get<string>();
+    for(auto const& consumer: peer.at("consumers")) {
+      handler->addConsumer(consumer, name);
     }
   }
 
-  void addConsumer(json const consumer) {
+  void addConsumer(JsonView const consumer) {
     handler->addConsumer(consumer);
   }
 };
@@ -1,11 +1,109 @@
 #ifndef _VoiceChannelData_h_
 #define _VoiceChannelData_h_
 
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 #include "json.hpp"
+#include "JsonView.h"
+#include "RtpParameters.h"
+#include "StringPool.h"
 
 using json = nlohmann::json;
+using std::string;
 
-using ConsumerInfo = json;
-using RoomSettings = json;
+struct ConsumerInfo {
+  // Empty when the server did not say which peer the consumer belongs to.
+  PooledString peerName;
+  PooledString kind;
+  // Unique per consumer, so not worth pooling.
+  string streamId;
+  string trackId;
+  uint32_t ssrc = 0;
+  PooledString cname;
+  // 0 when the consumer has no RTX stream.
+  uint32_t rtxSsrc = 0;
+  // The codecs and header extensions the consumer is sent with, shared by
+  // the copies of its info.
+  std::shared_ptr<const RtpParameters> rtpParameters;
+};
+
+void to_json(json& j, const ConsumerInfo& info) {
+  j = {
+    {"kind", info.kind},
+    {"streamId", info.streamId},
+    {"trackId", info.trackId},
+    {"ssrc", info.ssrc},
+    {"cname", info.cname}
+  };
+  if (info.rtxSsrc != 0) {
+    j.emplace("rtxSsrc", info.rtxSsrc);
+  }
+}
+
+/**
+ * What one receive renegotiation changes in the consumer set, relative to
+ * the previous one: the consumers to put into the offer and to take out.
+ */
+struct ConsumerDelta {
+  int version = 0;
+  std::map<int, ConsumerInfo> added;
+  std::map<int, ConsumerInfo> removed;
+
+  bool empty() const {
+    return added.empty() && removed.empty();
+  }
+
+  // Including RTX SSRCs.
+  std::vector<uint32_t> removedSsrcs() const {
+    std::vector<uint32_t> ssrcs;
+    for (auto const& entry : removed) {
+      ssrcs.push_back(entry.second.ssrc);
+      if (entry.second.rtxSsrc != 0) {
+        ssrcs.push_back(entry.second.rtxSsrc);
+      }
+    }
+    return ssrcs;
+  }
+};
+
+ConsumerDelta diffConsumers(std::map<int, ConsumerInfo> const& from, std::map<int, ConsumerInfo> const& to, int version) {
+  ConsumerDelta delta;
+  delta.version = version;
+  for (auto const& entry : to) {
+    if (from.count(entry.first) == 0) {
+      delta.added.insert(entry);
+    }
+  }
+  for (auto const& entry : from) {
+    if (to.count(entry.first) == 0) {
+      delta.removed.insert(entry);
+    }
+  }
+  return delta;
+}
+
+void to_json(json& j, const ConsumerDelta& delta) {
+  auto added = json::array();
+  for (auto const& entry : delta.added) {
+    json info = entry.second;
+    info.emplace("id", entry.first);
+    added.push_back(std::move(info));
+  }
+  auto removed = json::array();
+  for (auto const& entry : delta.removed) {
+    removed.push_back(entry.first);
+  }
+  j = {
+    {"version", delta.version},
+    {"added", std::move(added)},
+    {"removed", std::move(removed)},
+    {"removedSsrcs", delta.removedSsrcs()}
+  };
+}
+
+using RoomSettings = JsonView;
 
 #endif //_VoiceChannelData_h_
@@ -7,10 +7,12 @@
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/websocket/ssl.hpp>
 
+#include <cstdint>
 #include <string>
 #include "json.hpp"
 #include "log.h"
 #include "request_id.h"
+#include "SignalingProfiler.h"
 
 using tcp = boost::asio::ip::tcp;
 using json = nlohmann::json;
@@ -47,10 +49,24 @@ class WebSocketTransport
   boost::beast::multi_buffer buffer; // used to read incoming websocket messages
 
   std::map<int, std::function<void(json)>> handlers;
+  // Parser callbacks that see the "data" of a response while it is parsed.
+  std::map<int, json::parser_callback_t> dataParsers;
 
   std::queue<json> writes;
   bool isWriting = false;
 
+  public:
+  // Signaling traffic over this transport, as serialized JSON.
+  struct TrafficStats {
+    uint64_t messagesSent = 0;
+    uint64_t bytesSent = 0;
+    uint64_t messagesReceived = 0;
+    uint64_t bytesReceived = 0;
+  };
+
+  private:
+  TrafficStats traffic;
+
   public:
   WebSocketTransport(
     boost::asio::io_context &ioc,
@@ -87,7 +103,18 @@ class WebSocketTransport
     }
   }
 
-  void request(string method, json data, std::function<void(json)> onResponse) {
+  /**
+   * Sends a request. If onResponseData is given, it is called for every
+   * parse event inside the response "data" (with depths relative to it)
+   * while the response is being parsed, and can drop values from the
+   * document that is finally passed to onResponse.
+   */
+  void request(
+    string method,
+    json data,
+    std::function<void(json)> onResponse,
+    json::parser_callback_t onResponseData = nullptr
+  ) {
       int requestId = make_request_id();
       json req = {
         {"request", true},
@@ -97,6 +124,9 @@ class WebSocketTransport
       };
 
       handlers.emplace(requestId, onResponse);
+      if (onResponseData) {
+        dataParsers.emplace(requestId, onResponseData);
+      }
       send(req);
     }
 
@@ -104,12 +134,28 @@ class WebSocketTransport
     ws.close(websocket::close_code::normal);
   }
 
+  TrafficStats const& trafficStats() const {
+    return traffic;
+  }
+
+  void logTrafficStats() const {
+    log("Signaling traffic: " +
+        std::to_string(traffic.messagesSent) + " messages (" + std::to_string(traffic.bytesSent) + " bytes) sent, " +
+        std::to_string(traffic.messagesReceived) + " messages (" + std::to_string(traffic.bytesReceived) + " bytes) received");
+  }
+
   private:
   void doWrite() {
     isWriting = true;
     auto payload = writes.front();
     writes.pop();
-    auto output = payload.dump();
+    string output;
+    {
+      PROFILE_STAGE(dump);
+      output = payload.dump();
+    }
+    traffic.messagesSent++;
+    traffic.bytesSent += output.size();
     // log("Sending message " + output);
     ws.async_write(boost::asio::buffer(output), std::bind(
       &WebSocketTransport::onWriteDone,
@@ -229,6 +275,8 @@ class WebSocketTransport
     buffer.consume(buffer.size());
 
     auto str = ss.str();
+    traffic.messagesReceived++;
+    traffic.bytesReceived += str.size();
 
     // log("Message: " + str);
 
@@ -237,31 +285,80 @@ class WebSocketTransport
 
     json parsed;
     try {
-      parsed = json::parse(str);
+      PROFILE_STAGE(parse);
+      if (dataParsers.empty()) {
+        parsed = json::parse(str);
+      } else {
+        parsed = json::parse(str, makeResponseDataRouter());
+      }
     } catch (json::type_error& e) {
       logError("Could not parse JSON: " + str);
       throw e;
     }
-    handleMessage(parsed);
+    handleMessage(std::move(parsed));
+  }
+
+  // Routes the parse events under "data" of a response to the parser
+  // registered for its id. Server requests and notifications have ids of
+  // their own and are left alone. This relies on "response" and "id"
+  // preceding "data", as protoo sends them.
+  json::parser_callback_t makeResponseDataRouter() {
+    struct State {
+      string topLevelKey;
+      bool isResponse = false;
+      bool hasId = false;
+      int id = 0;
+      json::parser_callback_t dataParser;
+    };
+    auto state = std::make_shared<State>();
+    return [=](int depth, json::parse_event_t event, json& parsed) {
+      if (depth == 1 && event == json::parse_event_t::key) {
+        state->topLevelKey = parsed.get<string>();
+        return true;
+      }
+      if (depth == 1 && event == json::parse_event_t::value
+          && (state->topLevelKey == "response" || state->topLevelKey == "id")) {
+        if (state->topLevelKey == "response") {
+          state->isResponse = parsed.is_boolean() && parsed.get<bool>();
+        } else if (parsed.is_number()) {
+          state->hasId = true;
+          state->id = parsed.get<int>();
+        }
+        if (state->isResponse && state->hasId && !state->dataParser) {
+          auto search = dataParsers.find(state->id);
+          if (search != dataParsers.end()) {
+            state->dataParser = search->second;
+            dataParsers.erase(search);
+          }
+        }
+        return true;
+      }
+      if (depth >= 1 && state->topLevelKey == "data" && state->dataParser) {
+        return state->dataParser(depth - 1, event, parsed);
+      }
+      return true;
+    };
   }
 
   void handleMessage(json parsed) {
+    PROFILE_STAGE(dispatch);
     bool isRequest = parsed.count("request") > 0 && parsed.at("request").get<bool>();
     bool isResponse = !isRequest && parsed.count("response") > 0 && parsed.at("response").get<bool>();
     if (isRequest) {
-      listener->handleRequest(parsed);
+      listener->handleRequest(std::move(parsed));
     } else if (isResponse) {
       int responseId = parsed.at("id").get<int>();
       auto search = handlers.find(responseId);
       if (search != handlers.end()) {
         std::function<void(json)> handler = handlers.find(responseId)->second;
         handlers.erase(responseId);
-        handler(parsed);
+        dataParsers.erase(responseId);
+        handler(std::move(parsed));
       } else {
         logError("No handler found for response " + std::to_string(responseId));
       }
     } else {
-      listener->onNotification(parsed);
+      listener->onNotification(std::move(parsed));
     }
   }
 };
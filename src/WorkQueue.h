@@ -8,6 +8,9 @@
 
 class WorkQueue {
   std::queue<std::function<void(std::function<void(void)>)>> elements;
+  bool paused = false;
+  // A task has started and not called its callback yet.
+  bool running = false;
 
   public:
   void run (std::function<void(std::function<void(void)>)> func) {
@@ -16,13 +19,25 @@ class WorkQueue {
     taskLoop();
   }
 
+  // Tasks added while paused are kept until resume() is called.
+  void pause () {
+    paused = true;
+  }
+
+  void resume () {
+    paused = false;
+    taskLoop();
+  }
+
   void taskLoop () {
-    if (!elements.empty()) {
+    if (!paused && !running && !elements.empty()) {
       auto workFunction = elements.front();
       elements.pop();
+      running = true;
       log(">=>=>=>=> Now running a task in the queue!");
       workFunction([=]() {
         log(">=>=>=>=> Task done!!");
+        running = false;
         taskLoop();
       });
     }
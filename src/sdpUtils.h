@@ -2,19 +2,57 @@
 #define _sdpUtils_h_
 
 #include <boost/algorithm/string.hpp>
-
-#include <sdptransform/sdptransform.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <json.hpp>
+#include "H264ProfileLevelId.h"
+#include "RtpRegistry.h"
+#include "SignalingProfiler.h"
+#include "log.h"
+#include "SdpScanner.h"
 
 using std::string;
 
 namespace ortc {
-  json getRtpCapabilities(json extendedRtpCapabilities) {
+  using rtpRegistry::CodecRole;
+
+  CodecRole codecRole(json const& codec) {
+    return rtpRegistry::codecRole(codec.at("name").get_ref<const string&>());
+  }
+
+  // Which optional codecs to negotiate when both sides support them.
+  struct NegotiationOptions {
+    // red, ulpfec and flexfec: some extra bandwidth for fewer retransmissions.
+    bool fec = true;
+    // Comfort noise, so silence is sent as small CN packets.
+    bool comfortNoise = true;
+
+    bool accepts(CodecRole role) const {
+      switch (role) {
+        case CodecRole::fec: return fec;
+        case CodecRole::comfortNoise: return comfortNoise;
+        default: return true;
+      }
+    }
+
+    bool operator==(NegotiationOptions const& other) const {
+      return fec == other.fec && comfortNoise == other.comfortNoise;
+    }
+  };
+
+  json getRtpCapabilities(json const& extendedRtpCapabilities) {
+    PROFILE_STAGE(rtpCaps);
     auto codecs = json::array();
     auto headerExtensions = json::array();
 
-    for (auto capCodec : extendedRtpCapabilities.at("codecs")) {
+    for (auto const& capCodec : extendedRtpCapabilities.at("codecs")) {
       json codec = {
         {"name", capCodec.at("name")},
         {"mimeType", capCodec.at("mimeType")},
@@ -31,12 +69,13 @@ namespace ortc {
 
       codecs.push_back(codec);
 
-      // Add RTX codec.
-      if (capCodec.count("recvRtxPayloadType")) {
+      // Add RTX codec. FEC and CN codecs are in the extended codecs like any
+      // other, so they come out above.
+      if (capCodec.count("recvRtxPayloadType") > 0 && !capCodec.at("recvRtxPayloadType").is_null()) {
         // log("capCodec: " + capCodec.dump());
         json rtxCapCodec = {
-          {"name", "rtx"},
-          {"mimeType", capCodec.at("kind").get<string>() + "/rtx"},
+          {"name", rtpRegistry::codec(rtpRegistry::CodecId::rtx).name},
+          {"mimeType", capCodec.at("kind").get<string>() + "/" + rtpRegistry::codec(rtpRegistry::CodecId::rtx).name},
           {"kind", capCodec.at("kind")},
           {"clockRate", capCodec.at("clockRate")},
           {"preferredPayloadType", capCodec.at("recvRtxPayloadType")},
@@ -48,11 +87,9 @@ namespace ortc {
         // log("FOUND RTX CODEC, ADD IT");
         codecs.push_back(rtxCapCodec);
       }
-
-      // TODO: In the future, we need to add FEC, CN, etc, codecs.
     }
 
-    for(auto capExt : extendedRtpCapabilities.at("headerExtensions")) {
+    for(auto const& capExt : extendedRtpCapabilities.at("headerExtensions")) {
       json ext = {
         {"kind", capExt.at("kind")},
         {"uri", capExt.at("uri")},
@@ -68,25 +105,41 @@ namespace ortc {
     };
   }
 
-  bool matchCapCodecs (json aCodec, json bCodec) {
-    auto aMimeType = boost::algorithm::to_lower_copy(aCodec.at("mimeType").get<string>());
-    auto bMimeType = boost::algorithm::to_lower_copy(bCodec.at("mimeType").get<string>());
-    if (aMimeType !=  bMimeType) {
+  bool isH264 (json const& codec) {
+    return rtpRegistry::findCodecByMimeType(codec.at("mimeType").get_ref<const string&>()).id == rtpRegistry::CodecId::h264;
+  }
+
+  h264::CodecParameters h264Parameters (json const& codec) {
+    return h264::CodecParameters::fromJson(codec.count("parameters") > 0 ? codec.at("parameters") : json::object());
+  }
+
+  // Everything but the codec specific parameters.
+  bool matchCapCodecTypes (json const& aCodec, json const& bCodec) {
+    if (!rtpRegistry::equalsIgnoreCase(aCodec.at("mimeType").get_ref<const string&>(),
+                                       bCodec.at("mimeType").get_ref<const string&>())) {
       return false;
     }
     if (aCodec.at("clockRate") != bCodec.at("clockRate")) {
       return false;
     }
-    if (aCodec.count("channels") > 0 && aCodec.at("channels") != bCodec.at("channels")) {
+    // A missing channel count means 1.
+    if (aCodec.value("channels", 1) != bCodec.value("channels", 1)) {
       return false;
     }
+    return true;
+  }
 
-    // TODO: Match H264 parameters.
-
+  bool matchCapCodecs (json const& aCodec, json const& bCodec) {
+    if (!matchCapCodecTypes(aCodec, bCodec)) {
+      return false;
+    }
+    if (isH264(aCodec)) {
+      return h264::isCompatible(h264Parameters(aCodec), h264Parameters(bCodec));
+    }
     return true;
   }
 
-  bool matchCapHeaderExtensions(json aExt, json bExt) {
+  bool matchCapHeaderExtensions(json const& aExt, json const& bExt) {
     if (aExt.count("kind") > 0 && bExt.count("kind") > 0 && aExt.at("kind") != bExt.at("kind")) {
       return false;
     }
@@ -96,142 +149,361 @@ namespace ortc {
     return true;
   }
 
-  json reduceRtcpFeedback(json codecA, json codecB) {
+  json reduceRtcpFeedback(json const& codecA, json const& codecB) {
     auto reducedRtcpFeedback = json::array();
-    if (codecA.count("rtcpFeedback")) {
-      for (auto aFb : codecA.at("rtcpFeedback")) {
-        if (codecB.count("rtcpFeedback")) {
-          auto codecBRtcpFeedback = codecB.at("rtcpFeedback").get<std::vector<json>>();
-          auto search = std::find_if(codecBRtcpFeedback.begin(), codecBRtcpFeedback.end(), [&](auto bFb) {
-              return bFb.at("type") == aFb.at("type") && bFb.at("parameter") == aFb.at("parameter");
-          });
-          if (search != codecBRtcpFeedback.end()) {
-            reducedRtcpFeedback.push_back(*search);
-          }
+    if (codecA.count("rtcpFeedback") && codecB.count("rtcpFeedback")) {
+      auto const& codecBRtcpFeedback = codecB.at("rtcpFeedback");
+      for (auto const& aFb : codecA.at("rtcpFeedback")) {
+        auto search = std::find_if(codecBRtcpFeedback.begin(), codecBRtcpFeedback.end(), [&](json const& bFb) {
+            return bFb.at("type") == aFb.at("type") && bFb.value("parameter", "") == aFb.value("parameter", "");
+        });
+        if (search != codecBRtcpFeedback.end()) {
+          reducedRtcpFeedback.push_back(*search);
         }
       }
     }
     return reducedRtcpFeedback;
   }
 
-  json getExtendedRtpCapabilities(json localCaps, json remoteCaps) {
+  /**
+   * Hash indexes over one side's capabilities, built once per negotiation so
+   * that matching the other side against it is a lookup rather than a linear
+   * scan over a copied vector of codecs for every remote entry.
+   *
+   * The indexed json must outlive the index.
+   */
+  class CapabilitiesIndex {
+    // Media codecs by mimeType hash and clockRate, in capability order.
+    // Candidates still go through matchCapCodecs for the remaining checks,
+    // which also weeds out hash collisions.
+    std::unordered_map<uint64_t, std::vector<const json*>> codecsByMimeType;
+    // RTX codecs by the payload type they are associated with (apt).
+    std::unordered_map<int, const json*> rtxCodecsByApt;
+    // Header extensions by URI, in capability order.
+    std::unordered_map<string, std::vector<const json*>> headerExtensionsByUri;
+    // Parsed once here, so matching never goes back to the fmtp parameters.
+    std::unordered_map<const json*, h264::CodecParameters> h264ParametersByCodec;
+
+    static uint64_t codecKey(json const& codec) {
+      return static_cast<uint64_t>(rtpRegistry::hashLower(codec.at("mimeType").get_ref<const string&>())) << 32 |
+        codec.at("clockRate").get<uint32_t>();
+    }
+
+    public:
+    explicit CapabilitiesIndex(json const& caps) {
+      if (caps.count("codecs") > 0) {
+        auto const& codecs = caps.at("codecs");
+        codecsByMimeType.reserve(codecs.size());
+        for (auto const& codec : codecs) {
+          if (codecRole(codec) == CodecRole::rtx) {
+            if (codec.count("parameters") > 0 && codec.at("parameters").is_object() &&
+                codec.at("parameters").count("apt") > 0) {
+              rtxCodecsByApt.emplace(codec.at("parameters").at("apt").get<int>(), &codec);
+            }
+          } else {
+            codecsByMimeType[codecKey(codec)].push_back(&codec);
+            if (isH264(codec)) {
+              h264ParametersByCodec.emplace(&codec, h264Parameters(codec));
+            }
+          }
+        }
+      }
+      if (caps.count("headerExtensions") > 0) {
+        for (auto const& ext : caps.at("headerExtensions")) {
+          headerExtensionsByUri[ext.at("uri").get<string>()].push_back(&ext);
+        }
+      }
+    }
+
+    // First indexed codec matching the given one, or nullptr.
+    const json* findCodec(json const& codec) const {
+      return findCodec(codec, [](json const&) { return true; });
+    }
+
+    // First indexed codec matching the given one that accept() takes, or
+    // nullptr. Pass codecH264 if the codec's H264 parameters are known.
+    template<typename Accept>
+    const json* findCodec(json const& codec, Accept accept, h264::CodecParameters const* codecH264 = nullptr) const {
+      auto search = codecsByMimeType.find(codecKey(codec));
+      if (search == codecsByMimeType.end()) {
+        return nullptr;
+      }
+      h264::CodecParameters parsedH264;
+      if (codecH264 == nullptr && isH264(codec)) {
+        parsedH264 = h264Parameters(codec);
+        codecH264 = &parsedH264;
+      }
+      for (auto candidate : search->second) {
+        if (!matchCapCodecTypes(*candidate, codec) || !accept(*candidate)) {
+          continue;
+        }
+        auto candidateH264 = findH264Parameters(candidate);
+        if (candidateH264 != nullptr && codecH264 != nullptr && !h264::isCompatible(*candidateH264, *codecH264)) {
+          continue;
+        }
+        return candidate;
+      }
+      return nullptr;
+    }
+
+    // H264 parameters of an indexed codec, or nullptr if it is not H264.
+    h264::CodecParameters const* findH264Parameters(const json* codec) const {
+      auto search = h264ParametersByCodec.find(codec);
+      return search == h264ParametersByCodec.end() ? nullptr : &search->second;
+    }
+
+    // RTX codec associated with the given payload type, or nullptr.
+    const json* findRtxCodec(json const& payloadType) const {
+      auto search = rtxCodecsByApt.find(payloadType.get<int>());
+      return search == rtxCodecsByApt.end() ? nullptr : search->second;
+    }
+
+    // First indexed header extension matching the given one, or nullptr.
+    const json* findHeaderExtension(json const& ext) const {
+      auto search = headerExtensionsByUri.find(ext.at("uri").get<string>());
+      if (search == headerExtensionsByUri.end()) {
+        return nullptr;
+      }
+      for (auto candidate : search->second) {
+        if (matchCapHeaderExtensions(*candidate, ext)) {
+          return candidate;
+        }
+      }
+      return nullptr;
+    }
+  };
+
+  /**
+   * Payload types taken so far on one side of an extended codec list. A PT
+   * is only handed to one codec (media or RTX), so each local codec is
+   * paired at most once and an RTX codec never shadows a media codec.
+   */
+  class PayloadTypeAllocator {
+    std::set<int> used;
+
+    public:
+    bool isFree(json const& payloadType) const {
+      return payloadType.is_number_integer() && used.count(payloadType.get<int>()) == 0;
+    }
+
+    // Returns false if the PT is not valid or already taken.
+    bool claim(json const& payloadType) {
+      return isFree(payloadType) && used.insert(payloadType.get<int>()).second;
+    }
+  };
+
+  // ORTC fecMechanisms for the negotiated FEC codecs.
+  json getFecMechanisms(json const& codecs) {
+    bool red = false;
+    bool ulpfec = false;
+    bool flexfec = false;
+    for (auto const& codec : codecs) {
+      auto id = rtpRegistry::findCodec(codec.at("name").get_ref<const string&>()).id;
+      red = red || id == rtpRegistry::CodecId::red;
+      ulpfec = ulpfec || id == rtpRegistry::CodecId::ulpfec;
+      flexfec = flexfec || id == rtpRegistry::CodecId::flexfec;
+    }
+
+    auto fecMechanisms = json::array();
+    if (red) {
+      fecMechanisms.push_back(ulpfec ? "RED+ULPFEC" : "RED");
+    }
+    if (flexfec) {
+      fecMechanisms.push_back("FLEXFEC");
+    }
+    return fecMechanisms;
+  }
+
+  // remoteIndex must index remoteCaps; pass one built ahead of time when the
+  // same remote capabilities are negotiated against repeatedly.
+  json getExtendedRtpCapabilities(json const& localCaps, json const& remoteCaps, CapabilitiesIndex const& remoteIndex,
+                                  NegotiationOptions const& options = NegotiationOptions()) {
+    PROFILE_STAGE(extendedCaps);
     auto codecs = json::array();
     auto headerExtensions = json::array();
-    auto fecMechanisms = json::array();
+    CapabilitiesIndex localIndex(localCaps);
+    PayloadTypeAllocator sendPayloadTypes;
+    PayloadTypeAllocator recvPayloadTypes;
 
     if (remoteCaps.count("codecs") > 0) {
       // Match media codecs and keep the order preferred by remoteCaps.
-      for (auto &remoteCodec : remoteCaps.at("codecs")) {
-        // TODO: Ignore pseudo-codecs and feature codecs.
-        if (remoteCodec.at("name") == "rtx") {
-          // log("Found RTX codec, skip it!");
+      for (auto const& remoteCodec : remoteCaps.at("codecs")) {
+        // RTX is associated below; FEC and CN only when wanted.
+        auto role = codecRole(remoteCodec);
+        if (role == CodecRole::rtx || !options.accepts(role)) {
           continue;
         }
 
-        if (localCaps.count("codecs") > 0) {
-          auto localCapsCodecs = localCaps.at("codecs").get<std::vector<json>>();
-          auto searchMatchingLocalCodec = std::find_if(localCapsCodecs.begin(), localCapsCodecs.end(), [&](auto localCodec) {
-              return matchCapCodecs(localCodec, remoteCodec);
-          });
-          if (searchMatchingLocalCodec != localCapsCodecs.end()) {
-            json matchingLocalCodec = *searchMatchingLocalCodec;
-            json extendedCodec = {
-              {"name", remoteCodec.at("name")},
-              {"mimeType", remoteCodec.at("mimeType")},
-              {"kind", remoteCodec.at("kind")},
-              {"clockRate", remoteCodec.at("clockRate")},
-              {"sendPayloadType", remoteCodec.at("preferredPayloadType")},
-              {"sendRtxPayloadType", 102 /*nullptr */}, // TODO this should be nullptr, and the code should figure out 102 by itself!
-              {"recvPayloadType", remoteCodec.at("preferredPayloadType")},
-              {"recvRtxPayloadType", 102 /*nullptr */}, // TODO this should be nullptr, and the code should figure out 102 by itself!
-              {"rtcpFeedback", reduceRtcpFeedback(matchingLocalCodec, remoteCodec)},
-              {"parameters", remoteCodec.at("parameters")}
-            };
-            if (remoteCodec.count("channels") > 0) {
-              extendedCodec.emplace("channels", remoteCodec.at("channels"));
+        if (!recvPayloadTypes.isFree(remoteCodec.at("preferredPayloadType"))) {
+          continue;
+        }
+        auto remoteH264 = remoteIndex.findH264Parameters(&remoteCodec);
+        auto matchingLocalCodec = localIndex.findCodec(remoteCodec, [&](json const& localCodec) {
+          return sendPayloadTypes.isFree(localCodec.at("preferredPayloadType"));
+        }, remoteH264);
+        if (matchingLocalCodec != nullptr) {
+          sendPayloadTypes.claim(matchingLocalCodec->at("preferredPayloadType"));
+          recvPayloadTypes.claim(remoteCodec.at("preferredPayloadType"));
+          json extendedCodec = {
+            {"name", remoteCodec.at("name")},
+            {"mimeType", remoteCodec.at("mimeType")},
+            {"kind", remoteCodec.at("kind")},
+            {"clockRate", remoteCodec.at("clockRate")},
+            {"sendPayloadType", matchingLocalCodec->at("preferredPayloadType")},
+            {"sendRtxPayloadType", nullptr},
+            {"recvPayloadType", remoteCodec.at("preferredPayloadType")},
+            {"recvRtxPayloadType", nullptr},
+            {"rtcpFeedback", reduceRtcpFeedback(*matchingLocalCodec, remoteCodec)},
+            {"parameters", remoteCodec.at("parameters")}
+          };
+          if (remoteCodec.count("channels") > 0) {
+            extendedCodec.emplace("channels", remoteCodec.at("channels"));
+          }
+          if (remoteH264 != nullptr) {
+            auto profileLevelId = h264::profileLevelIdForAnswer(*localIndex.findH264Parameters(matchingLocalCodec), *remoteH264);
+            if (!profileLevelId.empty()) {
+              extendedCodec["parameters"]["profile-level-id"] = profileLevelId;
             }
-            codecs.push_back(extendedCodec);
           }
+          codecs.push_back(extendedCodec);
         }
       }
     }
 
-    // Match RTX codecs.
-    for (auto extendedCodec : codecs) {
-      /*
-      log("Match RTX codecs... " + codecs.dump());
-      log("LocalCaps " + localCaps.dump());
-      log("RemoteCaps " + remoteCaps.dump());
-      */
-
-      auto localCapsCodecs = localCaps.at("codecs").get<std::vector<json>>();
-      auto searchMatchingLocalRtxCodec = std::find_if(localCapsCodecs.begin(), localCapsCodecs.end(), [&](auto localCodec) {
-        return localCodec.at("name") == "rtx" && localCodec.at("parameters").count("apt") > 0 && localCodec.at("parameters").at("apt") == extendedCodec.at("sendPayloadType");
-      });
-
-      auto remoteCapsCodecs = remoteCaps.at("codecs").get<std::vector<json>>();
-      auto searchMatchingRemoteRtxCodec = std::find_if(remoteCapsCodecs.begin(), remoteCapsCodecs.end(), [&](auto remoteCodec) {
-        return remoteCodec.at("name") == "rtx" && extendedCodec.at("parameters").is_object() && extendedCodec.at("parameters").count("apt") > 0 && extendedCodec.at("parameters").at("apt") == extendedCodec.at("recvPayloadType");
-      });
-
-      if (searchMatchingLocalRtxCodec != localCapsCodecs.end() && searchMatchingRemoteRtxCodec != remoteCapsCodecs.end()) {
-        // log("FOUND MATCH SO WE ARE HERE WITH TYPES");
-        extendedCodec.emplace("sendRtxPayloadType", (*searchMatchingLocalRtxCodec).at("preferredPayloadType"));
-        extendedCodec.emplace("recvRtxPayloadType", (*searchMatchingRemoteRtxCodec).at("preferredPayloadType"));
+    // Match RTX codecs, once all media codecs have their PTs.
+    for (auto& extendedCodec : codecs) {
+      auto matchingLocalRtxCodec = localIndex.findRtxCodec(extendedCodec.at("sendPayloadType"));
+      auto matchingRemoteRtxCodec = remoteIndex.findRtxCodec(extendedCodec.at("recvPayloadType"));
+
+      if (matchingLocalRtxCodec != nullptr && matchingRemoteRtxCodec != nullptr &&
+          sendPayloadTypes.isFree(matchingLocalRtxCodec->at("preferredPayloadType")) &&
+          recvPayloadTypes.isFree(matchingRemoteRtxCodec->at("preferredPayloadType"))) {
+        sendPayloadTypes.claim(matchingLocalRtxCodec->at("preferredPayloadType"));
+        recvPayloadTypes.claim(matchingRemoteRtxCodec->at("preferredPayloadType"));
+        extendedCodec["sendRtxPayloadType"] = matchingLocalRtxCodec->at("preferredPayloadType");
+        extendedCodec["recvRtxPayloadType"] = matchingRemoteRtxCodec->at("preferredPayloadType");
       }
     }
 
     // Match header extensions.
-    for (auto remoteExt : remoteCaps.at("headerExtensions")) {
-      if (localCaps.count("headerExtensions") > 0) {
-        auto localCapsHeaderExtensions = localCaps.at("headerExtensions").get<std::vector<json>>();
-        auto matchingLocalExt = std::find_if(localCapsHeaderExtensions.begin(), localCapsHeaderExtensions.end(), [&](auto localExt) {
-          return matchCapHeaderExtensions(localExt, remoteExt);
-        });
-
-        if (matchingLocalExt != localCapsHeaderExtensions.end()) {
-          json extendedExt = {
-            {"kind", remoteExt.at("kind")},
-            {"uri", remoteExt.at("uri")},
-            {"sendId", (*matchingLocalExt).at("preferredId")},
-            {"recvId", remoteExt.at("preferredId")}
-          };
-          headerExtensions.push_back(extendedExt);
-        }
+    for (auto const& remoteExt : remoteCaps.at("headerExtensions")) {
+      auto matchingLocalExt = localIndex.findHeaderExtension(remoteExt);
+      if (matchingLocalExt != nullptr) {
+        json extendedExt = {
+          {"kind", remoteExt.at("kind")},
+          {"uri", remoteExt.at("uri")},
+          {"sendId", matchingLocalExt->at("preferredId")},
+          {"recvId", remoteExt.at("preferredId")}
+        };
+        headerExtensions.push_back(extendedExt);
       }
     }
 
     return {
       {"codecs", codecs},
       {"headerExtensions", headerExtensions},
-      {"fecMechanisms", fecMechanisms}
+      {"fecMechanisms", getFecMechanisms(codecs)}
     };
   }
+
+  json getExtendedRtpCapabilities(json const& localCaps, json const& remoteCaps,
+                                  NegotiationOptions const& options = NegotiationOptions()) {
+    return getExtendedRtpCapabilities(localCaps, remoteCaps, CapabilitiesIndex(remoteCaps), options);
+  }
 }
 
 namespace commonUtils {
-  json extractRtpCapabilities(json sdpObj) {
-    // auto dumped = sdpObj.dump();
-    // log("SDP OJB" + dumped);
+  // Splits an fmtp config into parameters, typed like sdptransform::parseFmtpConfig does,
+  // except that numbers too large for an int or a double are kept as strings.
+  json parseFmtpConfig(sdpScanner::string_view config) {
+    auto trim = [](sdpScanner::string_view str) {
+      while (!str.empty() && str.front() == ' ') {
+        str.remove_prefix(1);
+      }
+      while (!str.empty() && str.back() == ' ') {
+        str.remove_suffix(1);
+      }
+      return str;
+    };
+    // sdpScanner::parseInt, with an optional minus sign.
+    auto parseInt = [](sdpScanner::string_view str, int& value) {
+      bool negative = !str.empty() && str.front() == '-';
+      if (negative) {
+        str.remove_prefix(1);
+      }
+      if (!sdpScanner::parseInt(str, value)) {
+        return false;
+      }
+      if (negative) {
+        value = -value;
+      }
+      return true;
+    };
+    auto isFloat = [](sdpScanner::string_view str) {
+      if (!str.empty() && str.front() == '-') {
+        str.remove_prefix(1);
+      }
+      return std::count(str.begin(), str.end(), '.') == 1 &&
+        std::all_of(str.begin(), str.end(), [](char c) { return (c >= '0' && c <= '9') || c == '.'; });
+    };
+
+    json parameters = json::object();
+    while (!config.empty()) {
+      auto param = trim(sdpScanner::nextToken(config, ';'));
+      if (param.empty()) {
+        continue;
+      }
+      auto key = trim(sdpScanner::nextToken(param, '='));
+      auto value = trim(param);
+      string name(key.data(), key.size());
+      string valueStr(value.data(), value.size());
+      int number;
+
+      if (key == "profile-level-id" || key == "profile-id") {
+        parameters[name] = valueStr;
+      } else if (parseInt(value, number)) {
+        parameters[name] = number;
+      } else if (key == "packetization-mode") {
+        parameters[name] = 0;
+      } else if (isFloat(value)) {
+        errno = 0;
+        double floatNumber = std::strtod(valueStr.c_str(), nullptr);
+        if (errno == ERANGE) {
+          parameters[name] = valueStr;
+        } else {
+          parameters[name] = floatNumber;
+        }
+      } else {
+        parameters[name] = valueStr;
+      }
+    }
+    return parameters;
+  }
+
+  // The local capabilities offered in a scanned SDP: the codecs and header
+  // extensions of its first audio and video sections.
+  json extractRtpCapabilities(sdpScanner::SessionDescription const& session) {
     // Map of RtpCodecParameters indexed by payload type.
     std::map<int, json> codecsMap;
 
-    // Array of RtpHeaderExtensions.
-    std::vector<json> headerExtensions;
+    auto headerExtensions = json::array();
+    std::size_t headerExtensionCount = 0;
+    for (auto const& m : session.media) {
+      headerExtensionCount += m.ext.size();
+    }
+    headerExtensions.get_ref<json::array_t&>().reserve(headerExtensionCount);
 
     // Whether a m=audio/video section has been already found.
     bool gotAudio = false;
     bool gotVideo = false;
 
-    for (auto& m : sdpObj.at("media")) {
-      auto kind = m.at("type").get<string>();
-      if (kind == "audio") {
+    for (auto const& m : session.media) {
+      if (m.type == "audio") {
         if (gotAudio) {
           continue;
         }
         gotAudio = true;
-
-      } else if (kind == "video") {
+      } else if (m.type == "video") {
         if (gotVideo) {
           continue;
         }
@@ -239,122 +511,246 @@ namespace commonUtils {
       } else {
         continue;
       }
+      string kind(m.type.data(), m.type.size());
 
       // Get codecs.
-      for (auto &rtp : m.at("rtp")) {
-        auto codecName = rtp.at("codec").get<string>();
-        json channels = 1;
-        if (rtp.count("encoding") > 0) {
-          channels = rtp.at("encoding");
-        }
+      for (auto const& rtp : m.rtp) {
+        string codecName(rtp.codec.data(), rtp.codec.size());
         json codec = {
           {"name", codecName},
           {"mimeType", kind + "/" + codecName},
           {"kind", kind},
-          {"clockRate", rtp.at("rate")},
-          {"preferredPayloadType", rtp.at("payload")},
-          {"channels", channels},
+          {"clockRate", rtp.rate},
+          {"preferredPayloadType", rtp.payload},
           {"rtcpFeedback", json::array()},
-          {"parameters", json::array()}
+          {"parameters", json::object()}
         };
 
-        if (kind != "audio") {
-          codec.erase("channels");
+        if (kind == "audio") {
+          codec.emplace("channels", rtp.encoding > 0 ? rtp.encoding : 1);
         }
 
-        codecsMap.emplace(rtp.at("payload").get<int>(), codec);
+        codecsMap.emplace(rtp.payload, std::move(codec));
       }
 
       // Get codec parameters.
-      std::vector<json> fmtps;
-      if (m.count("fmtp") > 0) {
-        fmtps = m.at("fmtp").get<std::vector<json>>();
+      for (auto const& fmtp : m.fmtp) {
+        auto search = codecsMap.find(fmtp.payload);
+        if (search != codecsMap.end()) {
+          search->second.at("parameters") = parseFmtpConfig(fmtp.config);
+        }
       }
-      for (auto &fmtp : fmtps) {
-        auto parameters = sdptransform::parseFmtpConfig(fmtp.at("config").get<string>());
-        auto search = codecsMap.find(fmtp.at("payload").get<int>());
-        if (search == codecsMap.end()) {
-          continue;
+
+      // Get RTCP feedback for each codec. "*" applies to every codec of the
+      // section, and a feedback without subtype has no "parameter".
+      for (auto const& fb : m.rtcpFb) {
+        json feedback = {
+          {"type", string(fb.type.data(), fb.type.size())}
+        };
+        if (!fb.subtype.empty()) {
+          feedback.emplace("parameter", string(fb.subtype.data(), fb.subtype.size()));
+        }
+        auto addFeedback = [&](int payload) {
+          auto search = codecsMap.find(payload);
+          if (search == codecsMap.end()) {
+            return;
+          }
+          auto& rtcpFeedback = search->second.at("rtcpFeedback");
+          if (std::find(rtcpFeedback.begin(), rtcpFeedback.end(), feedback) == rtcpFeedback.end()) {
+            rtcpFeedback.push_back(feedback);
+          }
+        };
+        if (fb.payload == -1) {
+          for (auto const& rtp : m.rtp) {
+            addFeedback(rtp.payload);
+          }
         } else {
-          json codec = search->second;
-          codec.emplace("parameters", parameters);
+          addFeedback(fb.payload);
         }
       }
 
-      // Get RTCP feedback for each codec.
-      std::vector<json> rtcpFbs;
-      if (m.count("rtcpFb") > 0) {
-        rtcpFbs = m.at("rtcpFb").get<std::vector<json>>();
+      // Get RTP header extensions.
+      for (auto const& ext : m.ext) {
+        headerExtensions.push_back({
+          {"kind", kind},
+          {"uri", string(ext.uri.data(), ext.uri.size())},
+          {"preferredId", ext.value}
+        });
       }
-      for(auto &fb : rtcpFbs) {
-        // log("dump codecsmap " + json(codecsMap).dump());
-        int payload = 0;
-        if (fb.at("payload").is_string()) {
-          payload = std::stoi(fb.at("payload").get<string>());
-        } else {
-          payload = fb.at("payload").get<int>();
-        }
-        auto search = codecsMap.find(payload);
-        if (search == codecsMap.end()) {
-          continue;
-        } else {
-          json codec = search->second;
+    }
 
-          json feedback = {
-            {"type", fb.at("type")}
-          };
+    auto codecs = json::array();
+    codecs.get_ref<json::array_t&>().reserve(codecsMap.size());
+    for (auto& codecEntry : codecsMap) {
+      codecs.push_back(std::move(codecEntry.second));
+    }
 
-          if (fb.count("subtype") > 0) {
-            feedback.emplace("parameter", fb.at("subtype"));
-          }
+    json rtpCapabilities = json::object();
+    rtpCapabilities["codecs"] = std::move(codecs);
+    rtpCapabilities["headerExtensions"] = std::move(headerExtensions);
+    rtpCapabilities["fecMechanisms"] = json::array();
+    return rtpCapabilities;
+  }
+}
 
-          codec.at("rtcpFeedback").push_back(feedback);
-        }
-      }
+/**
+ * Identifies a room's rtpCapabilities to RtpCapabilitiesCache: their dump,
+ * shared with the cache entries, and its hash. Made once per compiled room
+ * (see RoomCapabilities::key()), so lookups never serialise the capabilities.
+ */
+class RoomCapabilitiesKey {
+  std::shared_ptr<const string> dump;
+  std::size_t dumpHash;
+
+  public:
+  explicit RoomCapabilitiesKey(json const& rtpCapabilities)
+    : dump(std::make_shared<const string>(rtpCapabilities.dump())),
+      dumpHash(std::hash<string>()(*dump)) {}
+
+  std::size_t hash() const {
+    return dumpHash;
+  }
 
-      // Get RTP header extensions.
-      if (m.count("ext") > 0) {
-        for (auto &ext : m.at("ext")) {
-          json headerExtension = {
-            {"kind", kind},
-            {"uri", ext.at("uri")},
-            {"preferredId", ext.at("value")}
-          };
-          headerExtensions.push_back(headerExtension);
-        }
+  // Keys made from equal capabilities are equal, even across compiles.
+  bool operator==(RoomCapabilitiesKey const& other) const {
+    return dumpHash == other.dumpHash && (dump == other.dump || *dump == *other.dump);
+  }
+};
+
+/**
+ * Process-wide memo of negotiated client capabilities.
+ *
+ * The local codec set and the room's rtpCapabilities rarely change between
+ * joins, so the result is keyed by the capability-relevant part of the local
+ * SDP, the room capabilities and the negotiation options, and only computed
+ * on a miss. A hit compares all three in full, so rooms whose keys hash the
+ * same never get each other's capabilities.
+ */
+class RtpCapabilitiesCache {
+  struct Entry {
+    string localKey;
+    RoomCapabilitiesKey roomKey;
+    ortc::NegotiationOptions options;
+    json capabilities;
+  };
+
+  // Enough for a handful of servers and devices; cleared when exceeded.
+  static constexpr std::size_t maxEntries = 64;
+
+  std::unordered_map<std::size_t, Entry> entries;
+  std::mutex mutex;
+  std::atomic<uint64_t> hitCount{0};
+  std::atomic<uint64_t> missCount{0};
+
+  public:
+  // Keeps only the lines capabilities are extracted from, dropping what
+  // changes from one offer to the next (origin, ICE, DTLS, ssrcs, msids...).
+  static string normalizeLocalSdp(string const& sdp) {
+    string normalized;
+    normalized.reserve(sdp.size() / 2);
+    std::size_t start = 0;
+    while (start < sdp.size()) {
+      auto end = sdp.find('\n', start);
+      if (end == string::npos) {
+        end = sdp.size();
+      }
+      auto lineEnd = end;
+      if (lineEnd > start && sdp[lineEnd - 1] == '\r') {
+        lineEnd--;
+      }
+      auto line = sdp.compare(start, 2, "m=") == 0 ||
+                  sdp.compare(start, 9, "a=rtpmap:") == 0 ||
+                  sdp.compare(start, 7, "a=fmtp:") == 0 ||
+                  sdp.compare(start, 10, "a=rtcp-fb:") == 0 ||
+                  sdp.compare(start, 9, "a=extmap:") == 0;
+      if (line) {
+        normalized.append(sdp, start, lineEnd - start);
+        normalized += '\n';
       }
+      start = end + 1;
     }
+    return normalized;
+  }
 
-    std::vector<json> codecs;
+  template<typename Compute>
+  json get(string const& sdp, RoomCapabilitiesKey const& roomKey, ortc::NegotiationOptions const& options,
+           Compute compute) {
+    auto localKey = normalizeLocalSdp(sdp);
+    auto key = (std::hash<string>()(localKey) * 31 + roomKey.hash()) * 4 +
+               (options.fec ? 2 : 0) + (options.comfortNoise ? 1 : 0);
 
-    for (auto &codecEntry : codecsMap)
     {
-      codecs.push_back(codecEntry.second);
+      std::lock_guard<std::mutex> lock(mutex);
+      auto search = entries.find(key);
+      if (search != entries.end() && search->second.localKey == localKey && search->second.roomKey == roomKey &&
+          search->second.options == options) {
+        hitCount++;
+        return search->second.capabilities;
+      }
     }
 
-    json rtpCapabilities = {
-      {"codecs", codecs},
-      {"headerExtensions", headerExtensions},
-      {"fecMechanisms", json::array()}
-    };
+    missCount++;
+    auto capabilities = compute();
 
-    return rtpCapabilities;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.size() >= maxEntries) {
+      entries.clear();
+    }
+    entries.erase(key);
+    entries.emplace(key, Entry{ std::move(localKey), roomKey, options, capabilities });
+    return capabilities;
+  }
+
+  uint64_t hits() const {
+    return hitCount;
   }
+  uint64_t misses() const {
+    return missCount;
+  }
+
+  void report() {
+    log("RTP capabilities cache: " + std::to_string(hits()) + " hits, " + std::to_string(misses()) + " misses");
+  }
+};
+
+RtpCapabilitiesCache& rtpCapabilitiesCache() {
+  static RtpCapabilitiesCache cache;
+  return cache;
 }
 
-json getExtendedRtpCapabilities(json sdpObj, json roomCapabilities) {
-  auto clientCapabilities = commonUtils::extractRtpCapabilities(sdpObj);
-  return ortc::getExtendedRtpCapabilities(
-    clientCapabilities,
-    roomCapabilities.at("rtpCapabilities")
-  );
+// The client's effective capabilities: the ones offered in the local sdp
+// that negotiate(clientCapabilities) keeps in the extended capabilities.
+template<typename Negotiate>
+json negotiateClientRtpCapabilities(string const& sdp, Negotiate negotiate) {
+  sdpScanner::SessionDescription session;
+  {
+    PROFILE_STAGE(sdpParse);
+    session = sdpScanner::scan(sdp);
+  }
+  auto clientCapabilities = commonUtils::extractRtpCapabilities(session);
+  return ortc::getRtpCapabilities(negotiate(clientCapabilities));
 }
 
-json getEffectiveClientRtpCapabilities(string sdp, json roomCapabilities) {
-  json sdpObj = sdptransform::parse(sdp);
-  auto extendedRtpCapabilities = getExtendedRtpCapabilities(sdpObj, roomCapabilities);
-  return ortc::getRtpCapabilities(extendedRtpCapabilities);
+// Cached version, for the room identified by roomCapabilitiesKey;
+// negotiate only runs on a cache miss.
+template<typename Negotiate>
+json getEffectiveClientRtpCapabilities(string const& sdp, RoomCapabilitiesKey const& roomCapabilitiesKey,
+                                       ortc::NegotiationOptions const& options, Negotiate negotiate) {
+  PROFILE_STAGE(sdpUtils);
+  return rtpCapabilitiesCache().get(sdp, roomCapabilitiesKey, options, [&]() {
+    return negotiateClientRtpCapabilities(sdp, negotiate);
+  });
 }
 
+// Not cached: the room settings would have to be serialised on every call
+// to be recognised. Compile them into RoomCapabilities to use the cache.
+json getEffectiveClientRtpCapabilities(string const& sdp, json const& roomCapabilities,
+                                       ortc::NegotiationOptions const& options = ortc::NegotiationOptions()) {
+  PROFILE_STAGE(sdpUtils);
+  auto const& remoteCaps = roomCapabilities.at("rtpCapabilities");
+  return negotiateClientRtpCapabilities(sdp, [&](json const& clientCapabilities) {
+    return ortc::getExtendedRtpCapabilities(clientCapabilities, remoteCaps, options);
+  });
+}
 
 #endif //_sdpUtils_h_
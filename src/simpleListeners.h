@@ -10,13 +10,16 @@ class SimpleCreateSessionDescriptionObserver : public webrtc::CreateSessionDescr
 private:
     std::string handlerName;
     std::function<void(webrtc::SessionDescriptionInterface* desc)> onSuccess;
+    std::function<void()> onFailure;
 public:
     explicit SimpleCreateSessionDescriptionObserver(
       std::string handlerName,
-      std::function<void(webrtc::SessionDescriptionInterface*)> onSuccess
+      std::function<void(webrtc::SessionDescriptionInterface*)> onSuccess,
+      std::function<void()> onFailure = nullptr
     ):
       handlerName(handlerName),
-      onSuccess(onSuccess) {}
+      onSuccess(onSuccess),
+      onFailure(onFailure) {}
 
     // CreateSessionDescriptionObserver implementation.
     void OnSuccess(webrtc::SessionDescriptionInterface* desc) override {
@@ -25,6 +28,9 @@ public:
 
     void OnFailure(const std::string& error) override {
       logError("Failed to create SDP [" + handlerName + "]: " + error);
+      if (onFailure) {
+        onFailure();
+      }
     };
 };
 
@@ -32,20 +38,26 @@ class SimpleSetSessionDescriptionObserver : public webrtc::SetSessionDescription
 private:
     std::string handlerName;
     std::function<void()> onSuccess;
+    std::function<void()> onFailure;
 
 public:
     explicit SimpleSetSessionDescriptionObserver(
       std::string handlerName,
-      std::function<void()> onSuccess
+      std::function<void()> onSuccess,
+      std::function<void()> onFailure = nullptr
     ):
       handlerName(handlerName),
-      onSuccess(onSuccess) {}
+      onSuccess(onSuccess),
+      onFailure(onFailure) {}
     void OnSuccess() override {
       log("Set SDP success [" + handlerName + "]!");
       onSuccess();
     };
     void OnFailure(const std::string& error) override {
       logError("Set SDP failed [" + handlerName + "]: " + error);
+      if (onFailure) {
+        onFailure();
+      }
     };
 };
 
@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include "json.hpp"
+#include "H264ProfileLevelId.h"
+
+using json = nlohmann::json;
+using std::string;
+using namespace h264;
+
+namespace {
+  ProfileLevelId parse(string const& str) {
+    ProfileLevelId result;
+    EXPECT_TRUE(parseProfileLevelId(str, result)) << str;
+    return result;
+  }
+
+  bool isValid(string const& str) {
+    ProfileLevelId result;
+    return parseProfileLevelId(str, result);
+  }
+
+  CodecParameters codecParameters(string const& profileLevelId, bool levelAsymmetryAllowed = false) {
+    return CodecParameters::fromJson({
+      {"packetization-mode", 1},
+      {"profile-level-id", profileLevelId},
+      {"level-asymmetry-allowed", levelAsymmetryAllowed ? 1 : 0}
+    });
+  }
+}
+
+TEST(H264ProfileLevelIdTest, ParsesEachProfilePattern) {
+  struct {
+    const char* profileLevelId;
+    Profile profile;
+  } cases[] = {
+    { "42e01f", Profile::constrainedBaseline }, // 42, x1xx0000
+    { "42401f", Profile::constrainedBaseline },
+    { "4d801f", Profile::constrainedBaseline }, // 4d, 1xxx0000
+    { "58c01f", Profile::constrainedBaseline }, // 58, 11xx0000
+    { "42001f", Profile::baseline },            // 42, x0xx0000
+    { "42a01f", Profile::baseline },
+    { "58801f", Profile::baseline },            // 58, 10xx0000
+    { "4d001f", Profile::main },                // 4d, 0x0x0000
+    { "4d501f", Profile::main },
+    { "64001f", Profile::high },                // 64, 00000000
+    { "640c1f", Profile::constrainedHigh }      // 64, 00001100
+  };
+
+  for (auto const& c : cases) {
+    SCOPED_TRACE(c.profileLevelId);
+    auto result = parse(c.profileLevelId);
+    EXPECT_EQ(result.profile, c.profile);
+    EXPECT_EQ(result.level, Level::level3_1);
+  }
+}
+
+TEST(H264ProfileLevelIdTest, ParsesUppercaseHex) {
+  EXPECT_EQ(parse("42E01F").profile, Profile::constrainedBaseline);
+  EXPECT_EQ(parse("4D001F").profile, Profile::main);
+}
+
+TEST(H264ProfileLevelIdTest, ParsesLevel1b) {
+  // constraint_set3 with level_idc 11 is level 1b in Baseline and Main...
+  EXPECT_EQ(parse("42f00b").level, Level::level1b);
+  EXPECT_EQ(parse("42100b").level, Level::level1b);
+  EXPECT_EQ(parse("4d100b").level, Level::level1b);
+  // ... and level 1.1 without it.
+  EXPECT_EQ(parse("42e00b").level, Level::level1_1);
+  EXPECT_EQ(parse("4d000b").level, Level::level1_1);
+
+  // The High profiles signal 1b with level_idc 9.
+  EXPECT_EQ(parse("640009").level, Level::level1b);
+  EXPECT_EQ(parse("640c09").level, Level::level1b);
+  EXPECT_EQ(parse("64000b").level, Level::level1_1);
+  EXPECT_FALSE(isValid("42e009"));
+  EXPECT_FALSE(isValid("4d0009"));
+}
+
+TEST(H264ProfileLevelIdTest, RejectsInvalidStrings) {
+  for (auto str : {
+    "",
+    "42e01",       // too short
+    "42e01f0",     // too long
+    "42g01f",      // not hex
+    "42e0 f",
+    "-2e01f",
+    "42e000",      // level_idc 0
+    "42e00e",      // level_idc 14
+    "42e035",      // level_idc 53
+    "43e01f",      // unknown profile_idc
+    "42f81f",      // reserved profile_iop bits set
+    "64011f",      // High with another profile_iop
+    "4d201f"       // Main with constraint_set2
+  }) {
+    EXPECT_FALSE(isValid(str)) << '"' << str << '"';
+  }
+}
+
+TEST(H264ProfileLevelIdTest, CodecParametersWithInvalidProfileLevelIdMatchNothing) {
+  auto invalid = codecParameters("zzzzzz");
+  EXPECT_FALSE(invalid.valid);
+  EXPECT_FALSE(isCompatible(invalid, invalid));
+
+  // Without a profile-level-id the RFC 6184 default applies.
+  auto defaulted = CodecParameters::fromJson({{"packetization-mode", "1"}});
+  EXPECT_TRUE(defaulted.valid);
+  EXPECT_FALSE(defaulted.hasProfileLevelId);
+  EXPECT_EQ(defaulted.packetizationMode, 1);
+  EXPECT_TRUE(isCompatible(defaulted, codecParameters("42e01f")));
+  EXPECT_FALSE(isCompatible(defaulted, codecParameters("4d001f")));
+  EXPECT_FALSE(isCompatible(defaulted, CodecParameters::fromJson({{"profile-level-id", "42e01f"}})));
+}
+
+TEST(H264ProfileLevelIdTest, WritesEachProfileAndLevel) {
+  for (auto str : { "42e01f", "42001f", "4d001f", "640c1f", "64001f", "42e034",
+                    "42f00b", "42100b", "4d100b", "640c09", "640009" }) {
+    EXPECT_EQ(profileLevelIdToString(parse(str)), str);
+  }
+  // Equivalent patterns are written the way libwebrtc writes them.
+  EXPECT_EQ(profileLevelIdToString(parse("4d801f")), "42e01f");
+  EXPECT_EQ(profileLevelIdToString(parse("58801f")), "42001f");
+}
+
+TEST(H264ProfileLevelIdTest, OrdersLevel1bBetween1And1_1) {
+  EXPECT_TRUE(isLess(Level::level1, Level::level1b));
+  EXPECT_TRUE(isLess(Level::level1b, Level::level1_1));
+  EXPECT_FALSE(isLess(Level::level1b, Level::level1b));
+  EXPECT_FALSE(isLess(Level::level1_1, Level::level1b));
+  EXPECT_EQ(min(Level::level3_1, Level::level1b), Level::level1b);
+  EXPECT_EQ(min(Level::level1, Level::level1b), Level::level1);
+}
+
+TEST(H264ProfileLevelIdTest, AnswersWithTheLowerLevel) {
+  // The local level is downgraded to the remote one...
+  EXPECT_EQ(profileLevelIdForAnswer(codecParameters("42e034"), codecParameters("42e01f")), "42e01f");
+  // ... but never raised.
+  EXPECT_EQ(profileLevelIdForAnswer(codecParameters("42e01f"), codecParameters("42e034")), "42e01f");
+  EXPECT_EQ(profileLevelIdForAnswer(codecParameters("4d001f"), codecParameters("4d100b")), "4d100b");
+  EXPECT_EQ(profileLevelIdForAnswer(codecParameters("640c1f"), codecParameters("640c09")), "640c09");
+
+  // Level asymmetry needs both sides to allow it.
+  EXPECT_EQ(profileLevelIdForAnswer(codecParameters("42e034", true), codecParameters("42e01f")), "42e01f");
+  EXPECT_EQ(profileLevelIdForAnswer(codecParameters("42e034"), codecParameters("42e01f", true)), "42e01f");
+  EXPECT_EQ(profileLevelIdForAnswer(codecParameters("42e034", true), codecParameters("42e01f", true)), "42e034");
+  EXPECT_EQ(profileLevelIdForAnswer(codecParameters("42e01f", true), codecParameters("42e034", true)), "42e01f");
+}
+
+TEST(H264ProfileLevelIdTest, AnswersWithoutProfileLevelIdWhenNeitherSideHasOne) {
+  auto none = CodecParameters::fromJson({{"packetization-mode", 1}});
+  EXPECT_EQ(profileLevelIdForAnswer(none, none), "");
+  // The default applies to the side without one.
+  EXPECT_EQ(profileLevelIdForAnswer(none, codecParameters("42e00d")), "42e00d");
+  EXPECT_EQ(profileLevelIdForAnswer(codecParameters("42e034"), none), "42e01f");
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "RemotePlanBSdp.h"
+#include "RemoteUnifiedPlanSdp.h"
+#include "sdpTestUtils.h"
+
+using json = nlohmann::json;
+using std::string;
+using sdpTestUtils::consumer;
+using sdpTestUtils::h264RtpParameters;
+using sdpTestUtils::linesStartingWith;
+using sdpTestUtils::sectionLines;
+using sdpTestUtils::transportRemoteParameters;
+using sdpTestUtils::vp8RtpParameters;
+
+TEST(RecvRemoteSdpTest, OffersTheCodecsOfEveryConsumerOfAKind) {
+  RecvRemoteSdp remoteSdp;
+  remoteSdp.setTransportRemoteParameters(transportRemoteParameters());
+  remoteSdp.addConsumer(1, consumer(1, vp8RtpParameters(), 1111));
+  remoteSdp.addConsumer(2, consumer(2, h264RtpParameters(), 2222));
+  auto video = sectionLines(remoteSdp.createOfferSdp(), "video");
+
+  EXPECT_EQ(linesStartingWith(video, "m="), std::vector<string>({
+    "m=video 7 RTP/SAVPF 101 102 107 108"
+  }));
+  EXPECT_EQ(linesStartingWith(video, "a=rtpmap:"), std::vector<string>({
+    "a=rtpmap:101 VP8/90000",
+    "a=rtpmap:102 rtx/90000",
+    "a=rtpmap:107 H264/90000",
+    "a=rtpmap:108 rtx/90000"
+  }));
+  EXPECT_EQ(linesStartingWith(video, "a=fmtp:"), std::vector<string>({
+    "a=fmtp:102 apt=101",
+    "a=fmtp:107 packetization-mode=1;profile-level-id=42e01f",
+    "a=fmtp:108 apt=107"
+  }));
+  // The extension both consumers have is offered once.
+  EXPECT_EQ(linesStartingWith(video, "a=extmap:"), std::vector<string>({
+    "a=extmap:4 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time",
+    "a=extmap:5 urn:3gpp:video-orientation"
+  }));
+  EXPECT_EQ(linesStartingWith(video, "a=ssrc:1111 cname:").size(), 1u);
+  EXPECT_EQ(linesStartingWith(video, "a=ssrc:2222 cname:").size(), 1u);
+}
+
+TEST(RecvRemoteSdpTest, DropsTheCodecsOfRemovedConsumers) {
+  RecvRemoteSdp remoteSdp;
+  remoteSdp.setTransportRemoteParameters(transportRemoteParameters());
+  remoteSdp.addConsumer(1, consumer(1, vp8RtpParameters(), 1111));
+  remoteSdp.addConsumer(2, consumer(2, h264RtpParameters(), 2222));
+  remoteSdp.addConsumer(3, consumer(3, vp8RtpParameters(), 3333));
+  remoteSdp.createOfferSdp();
+
+  ASSERT_TRUE(remoteSdp.removeConsumer(2));
+  auto video = sectionLines(remoteSdp.createOfferSdp(), "video");
+  EXPECT_EQ(linesStartingWith(video, "m="), std::vector<string>({
+    "m=video 7 RTP/SAVPF 101 102"
+  }));
+
+  // Without consumers the section goes inactive, still offering the codecs
+  // it had.
+  ASSERT_TRUE(remoteSdp.removeConsumer(1));
+  ASSERT_TRUE(remoteSdp.removeConsumer(3));
+  video = sectionLines(remoteSdp.createOfferSdp(), "video");
+  EXPECT_EQ(linesStartingWith(video, "m="), std::vector<string>({
+    "m=video 7 RTP/SAVPF 101 102"
+  }));
+  EXPECT_EQ(linesStartingWith(video, "a=inactive").size(), 1u);
+}
+
+TEST(RecvRemoteSdpTest, RejectsConsumersWithoutRtpParameters) {
+  RecvRemoteSdp remoteSdp;
+  auto info = consumer(1, vp8RtpParameters(), 1111);
+  info.rtpParameters = nullptr;
+  EXPECT_THROW(remoteSdp.addConsumer(1, info), std::invalid_argument);
+}
+
+TEST(RecvRemoteUnifiedPlanSdpTest, OffersEachConsumerItsOwnCodecs) {
+  RecvRemoteUnifiedPlanSdp remoteSdp;
+  remoteSdp.setTransportRemoteParameters(transportRemoteParameters());
+  remoteSdp.addConsumer(1, consumer(1, vp8RtpParameters(), 1111));
+  remoteSdp.addConsumer(2, consumer(2, h264RtpParameters(), 2222));
+  auto offer = remoteSdp.createOfferSdp();
+
+  EXPECT_EQ(linesStartingWith(sectionLines(offer, "0"), "a=rtpmap:"), std::vector<string>({
+    "a=rtpmap:101 VP8/90000",
+    "a=rtpmap:102 rtx/90000"
+  }));
+  EXPECT_EQ(linesStartingWith(sectionLines(offer, "1"), "a=rtpmap:"), std::vector<string>({
+    "a=rtpmap:107 H264/90000",
+    "a=rtpmap:108 rtx/90000"
+  }));
+  EXPECT_EQ(linesStartingWith(sectionLines(offer, "1"), "a=extmap:"), std::vector<string>({
+    "a=extmap:4 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time",
+    "a=extmap:5 urn:3gpp:video-orientation"
+  }));
+}
+
+TEST(RecvRemoteUnifiedPlanSdpTest, ReusedSectionsTakeTheNewConsumersCodecs) {
+  RecvRemoteUnifiedPlanSdp remoteSdp;
+  remoteSdp.setTransportRemoteParameters(transportRemoteParameters());
+  remoteSdp.addConsumer(1, consumer(1, vp8RtpParameters(), 1111));
+  remoteSdp.createOfferSdp();
+
+  // The inactive section keeps offering the codecs of its last consumer.
+  ASSERT_TRUE(remoteSdp.removeConsumer(1));
+  auto section = sectionLines(remoteSdp.createOfferSdp(), "0");
+  EXPECT_EQ(linesStartingWith(section, "m="), std::vector<string>({
+    "m=video 7 RTP/SAVPF 101 102"
+  }));
+  EXPECT_EQ(linesStartingWith(section, "a=inactive").size(), 1u);
+
+  remoteSdp.addConsumer(2, consumer(2, h264RtpParameters(), 2222));
+  auto offer = remoteSdp.createOfferSdp();
+  EXPECT_EQ(linesStartingWith(sectionLines(offer, "0"), "m="), std::vector<string>({
+    "m=video 7 RTP/SAVPF 107 108"
+  }));
+  EXPECT_TRUE(sectionLines(offer, "1").empty());
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "RemotePlanBSdp.h"
+#include "RemoteUnifiedPlanSdp.h"
+#include "SdpDiff.h"
+#include "sdpTestUtils.h"
+
+using json = nlohmann::json;
+using std::string;
+using sdpTestUtils::consumer;
+using sdpTestUtils::h264RtpParameters;
+using sdpTestUtils::transportRemoteParameters;
+using sdpTestUtils::vp8RtpParameters;
+
+// The Handler sets the last receive answer again, instead of creating a new
+// one, when a renegotiation only changes SSRCs. These check which consumer
+// changes allow that, on the offers the receive remote SDPs render.
+namespace {
+  template <typename RemoteSdp>
+  class Renegotiation {
+    RemoteSdp remoteSdp;
+    string appliedOffer;
+
+    public:
+    Renegotiation() {
+      remoteSdp.setTransportRemoteParameters(transportRemoteParameters());
+    }
+
+    RemoteSdp& sdp() {
+      return remoteSdp;
+    }
+
+    // What the next offer changes relative to the one applied last.
+    SdpDiff next() {
+      auto offer = remoteSdp.createOfferSdp();
+      auto diff = SdpDiff::compute(appliedOffer, offer);
+      appliedOffer = offer;
+      return diff;
+    }
+  };
+}
+
+TEST(SdpDiffTest, ReusesTheAnswerWhenAConsumerWithNegotiatedCodecsComesOrGoes) {
+  Renegotiation<RecvRemoteSdp> renegotiation;
+  renegotiation.sdp().addConsumer(1, consumer(1, vp8RtpParameters(), 1111));
+  // The first offer adds the video section.
+  EXPECT_TRUE(renegotiation.next().mediaChanged);
+
+  renegotiation.sdp().addConsumer(2, consumer(2, vp8RtpParameters(), 2222));
+  auto diff = renegotiation.next();
+  EXPECT_TRUE(diff.ssrcsOnly());
+  EXPECT_EQ(diff.addedSsrcs, std::vector<uint32_t>({ 2222 }));
+  EXPECT_TRUE(diff.removedSsrcs.empty());
+
+  ASSERT_TRUE(renegotiation.sdp().removeConsumer(1));
+  diff = renegotiation.next();
+  EXPECT_TRUE(diff.ssrcsOnly());
+  EXPECT_EQ(diff.removedSsrcs, std::vector<uint32_t>({ 1111 }));
+
+  // Nothing to renegotiate.
+  EXPECT_TRUE(renegotiation.next().empty());
+}
+
+TEST(SdpDiffTest, CreatesAnAnswerWhenTheOfferedCodecsChange) {
+  Renegotiation<RecvRemoteSdp> renegotiation;
+  renegotiation.sdp().addConsumer(1, consumer(1, vp8RtpParameters(), 1111));
+  renegotiation.next();
+
+  // The video section now offers H264 too, which the last answer lacks.
+  renegotiation.sdp().addConsumer(2, consumer(2, h264RtpParameters(), 2222));
+  auto diff = renegotiation.next();
+  EXPECT_FALSE(diff.ssrcsOnly());
+  EXPECT_TRUE(diff.codecsChanged);
+  EXPECT_TRUE(diff.headerExtensionsChanged);
+
+  // And drops it again.
+  ASSERT_TRUE(renegotiation.sdp().removeConsumer(2));
+  diff = renegotiation.next();
+  EXPECT_FALSE(diff.ssrcsOnly());
+  EXPECT_TRUE(diff.codecsChanged);
+}
+
+TEST(SdpDiffTest, CreatesAnAnswerWhenASectionGoesInactive) {
+  Renegotiation<RecvRemoteSdp> renegotiation;
+  renegotiation.sdp().addConsumer(1, consumer(1, vp8RtpParameters(), 1111));
+  renegotiation.next();
+
+  ASSERT_TRUE(renegotiation.sdp().removeConsumer(1));
+  auto diff = renegotiation.next();
+  EXPECT_FALSE(diff.ssrcsOnly());
+  EXPECT_TRUE(diff.mediaChanged);
+}
+
+TEST(SdpDiffTest, CreatesAnAnswerForEachUnifiedPlanConsumer) {
+  Renegotiation<RecvRemoteUnifiedPlanSdp> renegotiation;
+  renegotiation.sdp().addConsumer(1, consumer(1, vp8RtpParameters(), 1111));
+  renegotiation.next();
+
+  // Every consumer has its own m-section.
+  renegotiation.sdp().addConsumer(2, consumer(2, vp8RtpParameters(), 2222));
+  auto diff = renegotiation.next();
+  EXPECT_FALSE(diff.ssrcsOnly());
+  EXPECT_TRUE(diff.mediaChanged);
+}
+
+TEST(SdpDiffTest, TransportChangesAreNotSsrcsOnly) {
+  Renegotiation<RecvRemoteSdp> renegotiation;
+  renegotiation.sdp().addConsumer(1, consumer(1, vp8RtpParameters(), 1111));
+  renegotiation.next();
+
+  auto remoteParameters = transportRemoteParameters();
+  remoteParameters["iceParameters"]["password"] = "restarted";
+  renegotiation.sdp().setTransportRemoteParameters(remoteParameters);
+  renegotiation.sdp().addConsumer(2, consumer(2, vp8RtpParameters(), 2222));
+  auto diff = renegotiation.next();
+  EXPECT_TRUE(diff.transportChanged);
+  EXPECT_FALSE(diff.ssrcsOnly());
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+
+#include <sdptransform/sdptransform.hpp>
+#include <set>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "SdpMunger.h"
+#include "sdpTestUtils.h"
+
+using json = nlohmann::json;
+using std::string;
+using sdpTestUtils::readFixture;
+
+// Each stock stage on the session objects of the fixture offers.
+namespace {
+  json parseFixture(string const& name) {
+    return sdptransform::parse(readFixture(name));
+  }
+
+  json& mediaOfKind(json& session, string const& kind) {
+    for (auto& media : session.at("media")) {
+      if (media.at("type") == kind) {
+        return media;
+      }
+    }
+    throw std::runtime_error("No " + kind + " m-section");
+  }
+
+  // The fmtp parameters of a payload type, parsed.
+  json fmtpParameters(json const& media, int payloadType) {
+    for (auto const& fmtp : media.at("fmtp")) {
+      if (fmtp.at("payload").get<int>() == payloadType) {
+        return sdptransform::parseFmtpConfig(fmtp.at("config").get<string>());
+      }
+    }
+    return json::object();
+  }
+
+  std::vector<int> payloadTypesNamed(json const& media, string const& codecName) {
+    std::vector<int> payloadTypes;
+    for (auto const& rtp : media.at("rtp")) {
+      if (rtp.at("codec") == codecName) {
+        payloadTypes.push_back(rtp.at("payload").get<int>());
+      }
+    }
+    return payloadTypes;
+  }
+
+  std::vector<string> extensionUris(json const& media) {
+    std::vector<string> uris;
+    for (auto const& ext : media.value("ext", json::array())) {
+      uris.push_back(ext.at("uri").get<string>());
+    }
+    return uris;
+  }
+
+  // The audio and video offer with a flexfec-03 payload type after ulpfec.
+  json offerWithFlexfec() {
+    auto sdp = readFixture("chrome-planb-audio-video.sdp");
+    auto mLine = sdp.find("m=video");
+    auto mLineEnd = sdp.find("\r\n", mLine);
+    sdp.insert(mLineEnd, " 35");
+    auto ulpfec = sdp.find("a=rtpmap:116 ulpfec/90000\r\n");
+    sdp.insert(ulpfec, "a=rtpmap:35 flexfec-03/90000\r\na=fmtp:35 repair-window=10000000\r\n");
+    return sdptransform::parse(sdp);
+  }
+}
+
+TEST(SdpMungerTest, WithoutStagesReturnsTheSdpAsItIs) {
+  SdpMunger munger;
+  auto sdp = readFixture("chrome-planb-audio-video.sdp");
+  EXPECT_TRUE(munger.empty());
+  EXPECT_EQ(munger.apply(sdp), sdp);
+}
+
+TEST(SdpMungerTest, BitrateCapSetsAsAndTias) {
+  for (auto name : { "chrome-planb-audio.sdp", "chrome-planb-audio-video.sdp" }) {
+    SCOPED_TRACE(name);
+    auto session = parseFixture(name);
+    sdpMunging::bitrateCap("video", 500)(session);
+
+    for (auto const& media : session.at("media")) {
+      if (media.at("type") == "video") {
+        EXPECT_EQ(media.at("bandwidth"), json({
+          {{"type", "AS"}, {"limit", 500}},
+          {{"type", "TIAS"}, {"limit", 500000}}
+        }));
+      } else {
+        EXPECT_EQ(media.count("bandwidth"), 0u);
+      }
+    }
+  }
+
+  // "" caps every m-section.
+  auto session = parseFixture("chrome-planb-audio-video.sdp");
+  sdpMunging::bitrateCap("", 64)(session);
+  for (auto const& media : session.at("media")) {
+    EXPECT_EQ(media.at("bandwidth")[0].at("limit"), 64);
+  }
+}
+
+TEST(SdpMungerTest, PreferCodecMovesItsPayloadTypesFirst) {
+  auto session = parseFixture("chrome-planb-audio-video.sdp");
+  sdpMunging::preferCodec("video", "h264")(session);
+
+  auto& video = mediaOfKind(session, "video");
+  EXPECT_EQ(video.at("payloads"),
+    "102 127 125 108 124 123 96 97 98 99 100 101 122 121 107 109 120 119 114 115 116");
+  // Other kinds are left alone.
+  EXPECT_EQ(mediaOfKind(session, "audio").at("payloads"), "111 103 104 9 0 8 106 105 13 110 112 113 126");
+
+  // A codec the m-section does not have changes nothing.
+  auto before = session;
+  sdpMunging::preferCodec("video", "AV1X")(session);
+  EXPECT_EQ(session, before);
+}
+
+TEST(SdpMungerTest, OpusSettingsKeepTheOtherParameters) {
+  auto session = parseFixture("chrome-planb-audio.sdp");
+  sdpMunging::opusSettings(true, 96000)(session);
+
+  EXPECT_EQ(fmtpParameters(mediaOfKind(session, "audio"), 111), json({
+    {"minptime", 10},
+    {"useinbandfec", 1},
+    {"stereo", 1},
+    {"sprop-stereo", 1},
+    {"maxaveragebitrate", 96000}
+  }));
+
+  // Applying it again replaces the values rather than adding them twice.
+  sdpMunging::opusSettings(false, 0)(session);
+  auto const& fmtp = mediaOfKind(session, "audio").at("fmtp");
+  int opusLines = 0;
+  for (auto const& line : fmtp) {
+    if (line.at("payload").get<int>() == 111) {
+      opusLines++;
+      EXPECT_EQ(line.at("config"), "minptime=10;useinbandfec=1;stereo=0;sprop-stereo=0;maxaveragebitrate=96000");
+    }
+  }
+  EXPECT_EQ(opusLines, 1);
+}
+
+TEST(SdpMungerTest, StartBitrateSkipsRtxAndFec) {
+  auto session = offerWithFlexfec();
+  sdpMunging::startBitrate(800)(session);
+
+  auto& video = mediaOfKind(session, "video");
+  for (auto const& codecName : { "VP8", "VP9", "H264" }) {
+    for (auto payloadType : payloadTypesNamed(video, codecName)) {
+      SCOPED_TRACE(payloadType);
+      EXPECT_EQ(fmtpParameters(video, payloadType).at("x-google-start-bitrate"), 800);
+    }
+  }
+  // H264 keeps its profile and packetization parameters.
+  EXPECT_EQ(fmtpParameters(video, 102).at("profile-level-id"), "42001f");
+  EXPECT_EQ(fmtpParameters(video, 102).at("packetization-mode"), 1);
+
+  for (auto const& codecName : { "rtx", "red", "ulpfec", "flexfec-03" }) {
+    auto payloadTypes = payloadTypesNamed(video, codecName);
+    EXPECT_FALSE(payloadTypes.empty()) << codecName;
+    for (auto payloadType : payloadTypes) {
+      SCOPED_TRACE(payloadType);
+      EXPECT_EQ(fmtpParameters(video, payloadType).count("x-google-start-bitrate"), 0u);
+    }
+  }
+  EXPECT_EQ(fmtpParameters(video, 35), json({{"repair-window", 10000000}}));
+
+  // Audio has no start bitrate.
+  for (auto const& fmtp : mediaOfKind(session, "audio").at("fmtp")) {
+    EXPECT_EQ(fmtp.at("config").get<string>().find("x-google-start-bitrate"), string::npos);
+  }
+}
+
+TEST(SdpMungerTest, KeepHeaderExtensionsDropsTheOthers) {
+  auto session = parseFixture("chrome-planb-audio-video.sdp");
+  sdpMunging::keepHeaderExtensions({
+    "urn:ietf:params:rtp-hdrext:ssrc-audio-level",
+    "http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time",
+    "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01"
+  })(session);
+
+  EXPECT_EQ(extensionUris(mediaOfKind(session, "audio")), std::vector<string>({
+    "urn:ietf:params:rtp-hdrext:ssrc-audio-level"
+  }));
+  // In offer order.
+  EXPECT_EQ(extensionUris(mediaOfKind(session, "video")), std::vector<string>({
+    "http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time",
+    "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01"
+  }));
+
+  sdpMunging::keepHeaderExtensions({})(session);
+  EXPECT_TRUE(extensionUris(mediaOfKind(session, "audio")).empty());
+  EXPECT_TRUE(extensionUris(mediaOfKind(session, "video")).empty());
+}
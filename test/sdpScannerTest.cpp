@@ -0,0 +1,275 @@
+#include <gtest/gtest.h>
+
+#include <sdptransform/sdptransform.hpp>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "SdpScanner.h"
+#include "sdpUtils.h"
+#include "sdpTestUtils.h"
+
+using json = nlohmann::json;
+using std::string;
+using sdpTestUtils::readFixture;
+
+// The scanner and its capability extractor, checked against sdptransform and
+// the extractor that worked on its session objects.
+namespace {
+  string withoutCarriageReturns(string sdp) {
+    sdp.erase(std::remove(sdp.begin(), sdp.end(), '\r'), sdp.end());
+    return sdp;
+  }
+
+  int toInt(json const& value) {
+    return value.is_string() ? std::stoi(value.get<string>()) : value.get<int>();
+  }
+
+  // The sdptransform based extractor the scanner one replaced, with the
+  // same feedback rules: "*" applies to every codec of the section, and a
+  // feedback a codec already has is not added twice.
+  json referenceRtpCapabilities(json const& sdpObj) {
+    std::map<int, json> codecsMap;
+    auto headerExtensions = json::array();
+    bool gotAudio = false;
+    bool gotVideo = false;
+
+    for (auto const& m : sdpObj.at("media")) {
+      auto const& kind = m.at("type").get_ref<const string&>();
+      if (kind == "audio" && !gotAudio) {
+        gotAudio = true;
+      } else if (kind == "video" && !gotVideo) {
+        gotVideo = true;
+      } else {
+        continue;
+      }
+
+      for (auto const& rtp : m.at("rtp")) {
+        auto const& codecName = rtp.at("codec").get_ref<const string&>();
+        json codec = {
+          {"name", codecName},
+          {"mimeType", kind + "/" + codecName},
+          {"kind", kind},
+          {"clockRate", toInt(rtp.at("rate"))},
+          {"preferredPayloadType", toInt(rtp.at("payload"))},
+          {"rtcpFeedback", json::array()},
+          {"parameters", json::object()}
+        };
+        if (kind == "audio") {
+          codec.emplace("channels", rtp.count("encoding") > 0 ? toInt(rtp.at("encoding")) : 1);
+        }
+        codecsMap.emplace(toInt(rtp.at("payload")), std::move(codec));
+      }
+
+      if (m.count("fmtp") > 0) {
+        for (auto const& fmtp : m.at("fmtp")) {
+          auto search = codecsMap.find(toInt(fmtp.at("payload")));
+          if (search != codecsMap.end()) {
+            search->second.at("parameters") = sdptransform::parseFmtpConfig(fmtp.at("config").get<string>());
+          }
+        }
+      }
+
+      if (m.count("rtcpFb") > 0) {
+        for (auto const& fb : m.at("rtcpFb")) {
+          json feedback = {
+            {"type", fb.at("type")}
+          };
+          if (fb.count("subtype") > 0) {
+            feedback.emplace("parameter", fb.at("subtype"));
+          }
+          std::vector<int> payloads;
+          if (fb.at("payload").is_string() && fb.at("payload").get<string>() == "*") {
+            for (auto const& rtp : m.at("rtp")) {
+              payloads.push_back(toInt(rtp.at("payload")));
+            }
+          } else {
+            payloads.push_back(toInt(fb.at("payload")));
+          }
+          for (auto payload : payloads) {
+            auto search = codecsMap.find(payload);
+            if (search == codecsMap.end()) {
+              continue;
+            }
+            auto& rtcpFeedback = search->second.at("rtcpFeedback");
+            if (std::find(rtcpFeedback.begin(), rtcpFeedback.end(), feedback) == rtcpFeedback.end()) {
+              rtcpFeedback.push_back(feedback);
+            }
+          }
+        }
+      }
+
+      if (m.count("ext") > 0) {
+        for (auto const& ext : m.at("ext")) {
+          headerExtensions.push_back({
+            {"kind", kind},
+            {"uri", ext.at("uri")},
+            {"preferredId", toInt(ext.at("value"))}
+          });
+        }
+      }
+    }
+
+    auto codecs = json::array();
+    for (auto& codecEntry : codecsMap) {
+      codecs.push_back(std::move(codecEntry.second));
+    }
+    return {
+      {"codecs", std::move(codecs)},
+      {"headerExtensions", std::move(headerExtensions)},
+      {"fecMechanisms", json::array()}
+    };
+  }
+
+  // The SSRCs of each m-section, in order of first appearance, each once.
+  std::vector<std::vector<uint32_t>> referenceSsrcs(json const& sdpObj) {
+    std::vector<std::vector<uint32_t>> ssrcs;
+    for (auto const& m : sdpObj.at("media")) {
+      ssrcs.emplace_back();
+      if (m.count("ssrcs") == 0) {
+        continue;
+      }
+      for (auto const& ssrc : m.at("ssrcs")) {
+        auto id = ssrc.at("id").get<uint32_t>();
+        if (std::find(ssrcs.back().begin(), ssrcs.back().end(), id) == ssrcs.back().end()) {
+          ssrcs.back().push_back(id);
+        }
+      }
+    }
+    return ssrcs;
+  }
+
+  void expectSameAsSdptransform(string const& sdp) {
+    auto sdpObj = sdptransform::parse(sdp);
+    auto session = sdpScanner::scan(sdp);
+
+    EXPECT_EQ(commonUtils::extractRtpCapabilities(session), referenceRtpCapabilities(sdpObj));
+
+    std::vector<std::vector<uint32_t>> ssrcs;
+    for (auto const& media : session.media) {
+      ssrcs.push_back(media.ssrcs);
+    }
+    EXPECT_EQ(ssrcs, referenceSsrcs(sdpObj));
+  }
+
+  // A missing fmtp, an RTX codec without apt, wildcard feedback, and SSRC
+  // lines interleaved across a FID group.
+  const char* edgeCaseOffer =
+    "v=0\r\n"
+    "o=- 6817363741462853715 2 IN IP4 127.0.0.1\r\n"
+    "s=-\r\n"
+    "t=0 0\r\n"
+    "a=group:BUNDLE audio video\r\n"
+    "m=audio 9 UDP/TLS/RTP/SAVPF 111 0\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "a=mid:audio\r\n"
+    "a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n"
+    "a=sendrecv\r\n"
+    "a=rtcp-mux\r\n"
+    "a=rtpmap:111 opus/48000/2\r\n"
+    "a=rtcp-fb:111 transport-cc\r\n"
+    "a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+    "a=rtpmap:0 PCMU/8000\r\n"
+    "a=ssrc:1849561418 cname:zWr8Vx0qAuLdbk5q\r\n"
+    "a=ssrc:1849561418 msid:stream audio\r\n"
+    "m=video 9 UDP/TLS/RTP/SAVPF 96 97 98\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "a=mid:video\r\n"
+    "a=extmap:3 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\n"
+    "a=sendrecv\r\n"
+    "a=rtcp-mux\r\n"
+    "a=rtpmap:96 VP8/90000\r\n"
+    "a=rtcp-fb:* nack\r\n"
+    "a=rtcp-fb:96 nack\r\n"
+    "a=rtcp-fb:96 nack pli\r\n"
+    "a=rtpmap:97 rtx/90000\r\n"
+    "a=fmtp:97 apt=96\r\n"
+    "a=rtpmap:98 rtx/90000\r\n"
+    "a=ssrc-group:FID 3318264813 2940583394\r\n"
+    "a=ssrc:3318264813 cname:zWr8Vx0qAuLdbk5q\r\n"
+    "a=ssrc:2940583394 cname:zWr8Vx0qAuLdbk5q\r\n"
+    "a=ssrc:3318264813 msid:stream video\r\n"
+    "a=ssrc:2940583394 msid:stream video\r\n";
+}
+
+TEST(SdpScannerTest, MatchesSdptransformOnFixtures) {
+  for (auto name : { "chrome-planb-audio.sdp", "chrome-planb-audio-video.sdp" }) {
+    auto sdp = readFixture(name);
+    {
+      SCOPED_TRACE(string(name) + " (CRLF)");
+      expectSameAsSdptransform(sdp);
+    }
+    {
+      SCOPED_TRACE(string(name) + " (LF)");
+      expectSameAsSdptransform(withoutCarriageReturns(sdp));
+    }
+  }
+}
+
+TEST(SdpScannerTest, MatchesSdptransformOnEdgeCases) {
+  {
+    SCOPED_TRACE("CRLF");
+    expectSameAsSdptransform(edgeCaseOffer);
+  }
+  {
+    SCOPED_TRACE("LF");
+    expectSameAsSdptransform(withoutCarriageReturns(edgeCaseOffer));
+  }
+}
+
+TEST(SdpScannerTest, KeepsEachSsrcOnce) {
+  auto session = sdpScanner::scan(edgeCaseOffer);
+
+  ASSERT_EQ(session.media.size(), 2u);
+  EXPECT_EQ(session.media[0].ssrcs, std::vector<uint32_t>({ 1849561418 }));
+  EXPECT_EQ(session.media[1].ssrcs, std::vector<uint32_t>({ 3318264813, 2940583394 }));
+}
+
+TEST(SdpScannerTest, ExtractsCodecsWithoutFmtp) {
+  auto capabilities = commonUtils::extractRtpCapabilities(sdpScanner::scan(edgeCaseOffer));
+  std::map<int, json> codecs;
+  for (auto const& codec : capabilities.at("codecs")) {
+    codecs[codec.at("preferredPayloadType").get<int>()] = codec;
+  }
+
+  EXPECT_EQ(codecs.at(0).at("parameters"), json::object());
+  EXPECT_EQ(codecs.at(98).at("parameters"), json::object());
+  EXPECT_EQ(codecs.at(97).at("parameters"), json({{"apt", 96}}));
+  // The wildcard nack is not repeated for VP8, which has its own.
+  EXPECT_EQ(codecs.at(96).at("rtcpFeedback"), json({
+    {{"type", "nack"}},
+    {{"type", "nack"}, {"parameter", "pli"}}
+  }));
+  EXPECT_EQ(codecs.at(98).at("rtcpFeedback"), json({{{"type", "nack"}}}));
+}
+
+TEST(SdpScannerTest, SkipsOversizedIntegers) {
+  string sdp =
+    "v=0\r\n"
+    "m=video 9 UDP/TLS/RTP/SAVPF 96 97\r\n"
+    "a=rtpmap:96 VP8/90000\r\n"
+    "a=rtpmap:97 H264/99999999999\r\n"
+    "a=rtpmap:99999999999 VP9/90000\r\n"
+    "a=fmtp:96 max-fs=99999999999999999999999;max-fr=-30;x-google-start-bitrate=1000;"
+      "ratio=1" + string(400, '0') + ".5\r\n"
+    "a=ssrc:4294967295 cname:a\r\n"
+    "a=ssrc:4294967296 cname:b\r\n"
+    "a=ssrc:99999999999999999999 cname:c\r\n";
+  auto session = sdpScanner::scan(sdp);
+
+  ASSERT_EQ(session.media.size(), 1u);
+  EXPECT_EQ(session.media[0].ssrcs, std::vector<uint32_t>({ 4294967295u }));
+  ASSERT_EQ(session.media[0].rtp.size(), 1u);
+  EXPECT_EQ(session.media[0].rtp[0].payload, 96);
+
+  json capabilities;
+  ASSERT_NO_THROW(capabilities = commonUtils::extractRtpCapabilities(session));
+  ASSERT_EQ(capabilities.at("codecs").size(), 1u);
+  EXPECT_EQ(capabilities.at("codecs")[0].at("parameters"), json({
+    {"max-fs", "99999999999999999999999"},
+    {"max-fr", -30},
+    {"x-google-start-bitrate", 1000},
+    {"ratio", "1" + string(400, '0') + ".5"}
+  }));
+}
@@ -0,0 +1,123 @@
+#ifndef _sdpTestUtils_h_
+#define _sdpTestUtils_h_
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "VoiceChannelData.h"
+
+using json = nlohmann::json;
+using std::string;
+
+#ifndef MEDIASOUP_FIXTURES_DIR
+#define MEDIASOUP_FIXTURES_DIR "bench/fixtures"
+#endif
+
+// Helpers shared by the SDP tests: fixtures, consumers, and rendered SDP
+// checked line by line.
+namespace sdpTestUtils {
+  // A file of bench/fixtures.
+  string readFixture(string const& name) {
+    std::ifstream file(string(MEDIASOUP_FIXTURES_DIR) + "/" + name);
+    if (!file) {
+      throw std::runtime_error("Could not read fixture " + name);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+  }
+
+  json transportRemoteParameters() {
+    return {
+      {"iceParameters", {{"usernameFragment", "ufrag"}, {"password", "pwd"}, {"iceLite", true}}},
+      {"iceCandidates", {
+        {{"foundation", "udpcandidate"}, {"ip", "192.0.2.10"}, {"port", 40534}, {"priority", 1078862079},
+         {"protocol", "udp"}, {"type", "host"}}
+      }},
+      {"dtlsParameters", {
+        {"role", "auto"},
+        {"fingerprints", {{{"algorithm", "sha-256"}, {"value", "AB:CD"}}}}
+      }}
+    };
+  }
+
+  json vp8RtpParameters() {
+    return {
+      {"codecs", {
+        {{"name", "VP8"}, {"payloadType", 101}, {"clockRate", 90000},
+         {"rtcpFeedback", {{{"type", "nack"}}}}},
+        {{"name", "rtx"}, {"payloadType", 102}, {"clockRate", 90000}, {"parameters", {{"apt", 101}}}}
+      }},
+      {"headerExtensions", {
+        {{"uri", "http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time"}, {"id", 4}}
+      }}
+    };
+  }
+
+  json h264RtpParameters() {
+    return {
+      {"codecs", {
+        {{"name", "H264"}, {"payloadType", 107}, {"clockRate", 90000},
+         {"parameters", {{"packetization-mode", 1}, {"profile-level-id", "42e01f"}}}},
+        {{"name", "rtx"}, {"payloadType", 108}, {"clockRate", 90000}, {"parameters", {{"apt", 107}}}}
+      }},
+      {"headerExtensions", {
+        {{"uri", "http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time"}, {"id", 4}},
+        {{"uri", "urn:3gpp:video-orientation"}, {"id", 5}}
+      }}
+    };
+  }
+
+  // A video consumer with the given RTP parameters.
+  ConsumerInfo consumer(int id, json const& rtpParameters, uint32_t ssrc) {
+    ConsumerInfo info;
+    info.kind = stringPool().intern("video");
+    info.streamId = "recv-stream-" + std::to_string(id);
+    info.trackId = "consumer-video-" + std::to_string(id);
+    info.ssrc = ssrc;
+    info.cname = stringPool().intern("cname" + std::to_string(id));
+    info.rtpParameters = std::make_shared<const RtpParameters>(rtpParameters.get<RtpParameters>());
+    return info;
+  }
+
+  // The lines of the m-section with the given mid.
+  std::vector<string> sectionLines(string const& sdp, string const& mid) {
+    std::vector<std::vector<string>> sections;
+    std::istringstream stream(sdp);
+    string line;
+    while (std::getline(stream, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (line.compare(0, 2, "m=") == 0) {
+        sections.emplace_back();
+      }
+      if (!sections.empty()) {
+        sections.back().push_back(line);
+      }
+    }
+    for (auto const& section : sections) {
+      if (std::find(section.begin(), section.end(), "a=mid:" + mid) != section.end()) {
+        return section;
+      }
+    }
+    return {};
+  }
+
+  std::vector<string> linesStartingWith(std::vector<string> const& lines, string const& prefix) {
+    std::vector<string> matching;
+    for (auto const& line : lines) {
+      if (line.compare(0, prefix.size(), prefix) == 0) {
+        matching.push_back(line);
+      }
+    }
+    return matching;
+  }
+}
+
+#endif //_sdpTestUtils_h_
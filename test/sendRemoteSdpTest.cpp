@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "RemotePlanBSdp.h"
+#include "sdpTestUtils.h"
+
+using json = nlohmann::json;
+using std::string;
+using sdpTestUtils::linesStartingWith;
+using sdpTestUtils::sectionLines;
+using sdpTestUtils::transportRemoteParameters;
+
+namespace {
+  const char* localOffer =
+    "v=0\r\n"
+    "o=- 6817363741462853715 2 IN IP4 127.0.0.1\r\n"
+    "s=-\r\n"
+    "t=0 0\r\n"
+    "a=group:BUNDLE audio video\r\n"
+    "a=msid-semantic: WMS stream\r\n"
+    "m=audio 9 UDP/TLS/RTP/SAVPF 111\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "a=mid:audio\r\n"
+    "a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n"
+    "a=sendrecv\r\n"
+    "a=rtcp-mux\r\n"
+    "a=rtpmap:111 opus/48000/2\r\n"
+    "a=ssrc:1849561418 cname:zWr8Vx0qAuLdbk5q\r\n"
+    "m=video 9 UDP/TLS/RTP/SAVPF 96 97\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "a=mid:video\r\n"
+    "a=extmap:3 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\n"
+    "a=sendrecv\r\n"
+    "a=rtcp-mux\r\n"
+    "a=rtpmap:96 VP8/90000\r\n"
+    "a=rtpmap:97 rtx/90000\r\n"
+    "a=fmtp:97 apt=96\r\n"
+    "a=ssrc:3318264813 cname:zWr8Vx0qAuLdbk5q\r\n";
+
+  json sendRtpParametersByKind() {
+    return {
+      {"audio", {
+        {"codecs", {
+          {{"name", "opus"}, {"payloadType", 100}, {"clockRate", 48000}, {"channels", 2},
+           {"parameters", {{"useinbandfec", 1}}}, {"rtcpFeedback", {{{"type", "transport-cc"}}}}}
+        }},
+        {"headerExtensions", {
+          {{"uri", "urn:ietf:params:rtp-hdrext:sdes:mid"}, {"id", 1}},
+          {{"uri", "urn:ietf:params:rtp-hdrext:ssrc-audio-level"}, {"id", 2}}
+        }}
+      }},
+      {"video", {
+        {"codecs", {
+          {{"name", "VP8"}, {"payloadType", 101}, {"clockRate", 90000},
+           {"rtcpFeedback", {
+             {{"type", "nack"}},
+             {{"type", "nack"}, {"parameter", "pli"}},
+             {{"type", "goog-remb"}}
+           }}},
+          {{"name", "rtx"}, {"payloadType", 102}, {"clockRate", 90000}, {"parameters", {{"apt", 101}}}}
+        }},
+        {"headerExtensions", {
+          {{"uri", "urn:ietf:params:rtp-hdrext:sdes:mid"}, {"id", 1}},
+          {{"uri", "http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time"}, {"id", 4}}
+        }}
+      }}
+    };
+  }
+
+  string createAnswer() {
+    SendRemoteSdp remoteSdp(sendRtpParametersByKind());
+    remoteSdp.setTransportLocalParameters({{"role", "client"}});
+    remoteSdp.setTransportRemoteParameters(transportRemoteParameters());
+    return remoteSdp.createAnswerSdp(localOffer);
+  }
+}
+
+TEST(SendRemoteSdpTest, AnswersHeaderExtensionsWithoutMid) {
+  auto answer = createAnswer();
+
+  EXPECT_EQ(linesStartingWith(sectionLines(answer, "audio"), "a=extmap:"), std::vector<string>({
+    "a=extmap:2 urn:ietf:params:rtp-hdrext:ssrc-audio-level"
+  }));
+  EXPECT_EQ(linesStartingWith(sectionLines(answer, "video"), "a=extmap:"), std::vector<string>({
+    "a=extmap:4 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time"
+  }));
+}
+
+TEST(SendRemoteSdpTest, AnswersRtcpFeedback) {
+  auto answer = createAnswer();
+
+  EXPECT_EQ(linesStartingWith(sectionLines(answer, "audio"), "a=rtcp-fb:"), std::vector<string>({
+    "a=rtcp-fb:100 transport-cc"
+  }));
+  EXPECT_EQ(linesStartingWith(sectionLines(answer, "video"), "a=rtcp-fb:"), std::vector<string>({
+    "a=rtcp-fb:101 nack",
+    "a=rtcp-fb:101 nack pli",
+    "a=rtcp-fb:101 goog-remb"
+  }));
+}
+
+TEST(SendRemoteSdpTest, RerendersSectionsForNewTransport) {
+  SendRemoteSdp remoteSdp(sendRtpParametersByKind());
+  remoteSdp.setTransportLocalParameters({{"role", "client"}});
+  remoteSdp.setTransportRemoteParameters(transportRemoteParameters());
+  string first = remoteSdp.createAnswerSdp(localOffer);
+  string second = remoteSdp.createAnswerSdp(localOffer);
+
+  // Only the session version moves.
+  EXPECT_EQ(sectionLines(first, "video"), sectionLines(second, "video"));
+
+  auto parameters = transportRemoteParameters();
+  parameters["iceParameters"]["usernameFragment"] = "ufrag2";
+  remoteSdp.setTransportRemoteParameters(parameters);
+  string third = remoteSdp.createAnswerSdp(localOffer);
+
+  EXPECT_EQ(linesStartingWith(sectionLines(third, "video"), "a=ice-ufrag:"), std::vector<string>({
+    "a=ice-ufrag:ufrag2"
+  }));
+}
+
+TEST(SendRemoteSdpTest, RejectsSectionsWithoutSendParameters) {
+  string offer = string(localOffer) +
+    "m=application 9 UDP/DTLS/SCTP webrtc-datachannel\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "a=mid:data\r\n"
+    "a=sctp-port:5000\r\n";
+  auto parameters = sendRtpParametersByKind();
+  parameters.erase("video");
+
+  SendRemoteSdp remoteSdp(parameters);
+  remoteSdp.setTransportLocalParameters({{"role", "client"}});
+  remoteSdp.setTransportRemoteParameters(transportRemoteParameters());
+  string answer;
+  ASSERT_NO_THROW(answer = remoteSdp.createAnswerSdp(offer));
+
+  EXPECT_EQ(sectionLines(answer, "video"), std::vector<string>({
+    "m=video 0 UDP/TLS/RTP/SAVPF 96 97",
+    "c=IN IP4 127.0.0.0",
+    "a=mid:video",
+    "a=inactive"
+  }));
+  EXPECT_EQ(sectionLines(answer, "data"), std::vector<string>({
+    "m=application 0 UDP/DTLS/SCTP webrtc-datachannel",
+    "c=IN IP4 127.0.0.0",
+    "a=mid:data",
+    "a=inactive"
+  }));
+  EXPECT_EQ(linesStartingWith(sectionLines(answer, "audio"), "m="), std::vector<string>({
+    "m=audio 7 RTP/SAVPF 100"
+  }));
+  // Rejected m-sections are not bundled.
+  EXPECT_NE(answer.find("a=group:BUNDLE audio\r\n"), string::npos);
+}